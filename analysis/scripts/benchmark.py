@@ -8,7 +8,6 @@ import os
 
 import matplotlib.pyplot as plt
 import numpy as np
-import pandas as pd
 
 from scipy.ndimage import gaussian_filter
 from scipy.interpolate import interp2d, interp1d
@@ -17,6 +16,7 @@ from matplotlib.lines import Line2D
 from scipy.optimize import curve_fit
 
 from utils import (
+    read_scan,
     remove_nans,
     OMEGA_CDM_H2,
     SI_BOUND,
@@ -55,7 +55,7 @@ TITLES = ["Minimal", "Decorrelated", "Hot", "Low SI"]
 
 def generate_bm_plot(idx):
     # Load the benchmark data and extract needed quantities
-    data = pd.read_csv(DATA_FILES[idx])
+    data = read_scan(DATA_FILES[idx])
 
     data.sort_values(by=["LAM", "N"], inplace=True)
 
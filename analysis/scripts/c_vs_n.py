@@ -6,8 +6,7 @@ import matplotlib.pyplot as plt
 import matplotlib as mpl
 from matplotlib.lines import Line2D
 import numpy as np
-import pandas as pd
-from utils import remove_nans, OMEGA_CDM_H2, find_contour
+from utils import remove_nans, OMEGA_CDM_H2, find_contour, read_scan
 from scipy.interpolate import interp2d, interp1d
 
 
@@ -17,7 +16,7 @@ DATA_FILES = [BASE_PATH + "c_vs_n1.csv", BASE_PATH + "c_vs_n2.csv"]
 
 def generate_plot(idx):
     # Load the benchmark data and extract needed quantities
-    data = pd.read_csv(DATA_FILES[idx])
+    data = read_scan(DATA_FILES[idx])
 
     data.sort_values(by=["C", "N"], inplace=True)
     data.drop(
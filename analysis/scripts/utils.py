@@ -6,6 +6,7 @@ SU(N) simulations.
 """
 
 import numpy as np
+import pandas as pd
 from scipy.special import kv
 from scipy.interpolate import UnivariateSpline
 from sm_data import sm_geff_data, sm_heff_data, sm_sqrt_gstar_data, sm_temps
@@ -73,6 +74,54 @@ def remove_nans(arr):
         done = np.sum(np.isnan(arr)) == 0
 
 
+SCAN_MAGIC = b"DSNCOL01"
+
+
+def read_scan_columns(fname):
+    """
+    Memory-map the columns of a binary scan file written by the C++ Scanner
+    with `OutputFormat::Binary`. No data is read until it is accessed.
+
+    Parameters
+    ----------
+    fname: str
+        Path to the binary scan file.
+
+    Returns
+    -------
+    columns: dict
+        Dictionary mapping the column names (e.g. "RD_ETA") to read-only
+        np.memmap arrays. Row i corresponds to grid point i of the scan.
+    """
+    with open(fname, "rb") as f:
+        magic = f.read(8)
+        if magic != SCAN_MAGIC:
+            raise ValueError(f"{fname} is not a binary scan file")
+        num_cols, num_rows, offset = np.frombuffer(f.read(24), dtype="<u8")
+        names = f.read(int(offset) - 32).rstrip(b"\0").decode().split(",")
+    data = np.memmap(
+        fname,
+        dtype="<f8",
+        mode="r",
+        offset=int(offset),
+        shape=(int(num_cols), int(num_rows)),
+    )
+    return {name: data[i] for i, name in enumerate(names)}
+
+
+def read_scan(fname):
+    """
+    Read the results of a scan into a DataFrame. Binary scan files (see
+    `read_scan_columns`) are detected by their header; anything else is
+    parsed as CSV.
+    """
+    with open(fname, "rb") as f:
+        is_binary = f.read(8) == SCAN_MAGIC
+    if is_binary:
+        return pd.DataFrame(read_scan_columns(fname), copy=False)
+    return pd.read_csv(fname)
+
+
 class DarkSun:
     def __init__(self, n, lam, c, lec1, lec2, mu_eta, mu_del, xi_inf):
         self.n = n
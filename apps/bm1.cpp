@@ -3,12 +3,9 @@
  * of c such that the delta obtains the correct relic density at N=7.
  */
 
-#include <boost/timer/progress_display.hpp>
 #include <darksun/darksun.hpp>
 #include <darksun/scanner.hpp>
 #include <filesystem>
-#include <mutex>
-#include <thread>
 
 using namespace darksun;
 
@@ -31,9 +28,6 @@ static constexpr double C = 0.666544284531189;
 const std::string FNAME = std::filesystem::current_path().append(
     "../rundata/bm_lec1=0.1_lec2=1_xi_inf=1e-2.csv");
 
-static boost::timer::progress_display progress(NUM_N *NUM_LAM);
-static std::mutex progress_mutex;
-
 bool set_model(size_t i, DarkSunParameters &params) {
   if (i < NUM_LAM * NUM_N) {
     int idx_n = i % NUM_N;
@@ -45,11 +39,6 @@ bool set_model(size_t i, DarkSunParameters &params) {
     params.lec2 = LEC2;
     params.xi_inf = XI_INF;
     params.c = C;
-    {
-      std::lock_guard<std::mutex> lock(progress_mutex);
-      ++progress;
-    }
-
     return false;
   } else {
     return true;
@@ -57,6 +46,6 @@ bool set_model(size_t i, DarkSunParameters &params) {
 }
 
 int main() {
-  Scanner s(FNAME, set_model);
+  Scanner s(FNAME, set_model, NUM_N * NUM_LAM);
   s.scan();
 }
@@ -0,0 +1,60 @@
+/*
+ * Adaptive version of bm1: resolves the relic-density, Delta N_eff and
+ * self-interaction contours for lec1=0.1 and lec2=1.0 at the resolution of a
+ * 145x129 grid in (N, log10(lam)), computing only the points near the
+ * contours.
+ */
+
+#include <darksun/adaptive_scanner.hpp>
+#include <darksun/darksun.hpp>
+#include <filesystem>
+
+using namespace darksun;
+
+static constexpr size_t NUM_N = 19;
+static constexpr double N_MIN = 5;
+static constexpr double N_MAX = 35;
+
+static constexpr size_t NUM_LAM = 17;
+static constexpr double LOG_LAM_MIN = -7.0;
+static constexpr double LOG_LAM_MAX = 1.0;
+
+static constexpr size_t MAX_LEVEL = 3;
+
+static constexpr double LEC1 = 0.1;
+static constexpr double LEC2 = 1.0;
+static constexpr double XI_INF = 1e-2;
+static constexpr double C = 0.666544284531189;
+
+// Bounds used in analysis/scripts/benchmark.py
+static constexpr double NEFF_CMB_BOUND = 2.92 + 0.36;
+static constexpr double NEFF_BBN_BOUND = 2.85 + 0.28;
+static constexpr double SI_BOUND = 457.281; // 0.1 cm^2 / g
+
+const std::string FNAME = std::filesystem::current_path().append(
+    "../rundata/bm_lec1=0.1_lec2=1_xi_inf=1e-2_adaptive.csv");
+
+void set_point(double n, double log_lam, DarkSunParameters &params) {
+  params.n = n;
+  params.lam = pow(10.0, log_lam);
+  params.lec1 = LEC1;
+  params.lec2 = LEC2;
+  params.xi_inf = XI_INF;
+  params.c = C;
+}
+
+int main() {
+  std::vector<ContourFunction> contours = {
+      [](const DarkSunParameters &p) {
+        return log(p.rd_eta + p.rd_del) - log(OMEGA_H2_CDM);
+      },
+      [](const DarkSunParameters &p) { return p.dneff_cmb - NEFF_CMB_BOUND; },
+      [](const DarkSunParameters &p) { return p.dneff_bbn - NEFF_BBN_BOUND; },
+      [](const DarkSunParameters &p) { return p.eta_si_per_mass - SI_BOUND; },
+      [](const DarkSunParameters &p) { return p.del_si_per_mass - SI_BOUND; },
+  };
+  AdaptiveScanner s(FNAME, ScanAxis{N_MIN, N_MAX, NUM_N},
+                    ScanAxis{LOG_LAM_MIN, LOG_LAM_MAX, NUM_LAM}, set_point,
+                    contours, MAX_LEVEL);
+  s.scan();
+}
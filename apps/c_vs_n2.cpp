@@ -3,12 +3,9 @@
  * of c such that the delta obtains the correct relic density at N=7.
  */
 
-#include <boost/timer/progress_display.hpp>
 #include <darksun/darksun.hpp>
 #include <darksun/scanner.hpp>
 #include <filesystem>
-#include <mutex>
-#include <thread>
 
 using namespace darksun;
 
@@ -31,9 +28,6 @@ static constexpr double XI_INF = 5e-2;
 const std::string FNAME =
     "/home/logan/Research/DarkSun/cpp/rundata/c_vs_n_lam2.csv";
 
-static boost::timer::progress_display progress(NUM_N *NUM_CS);
-static std::mutex progress_mutex;
-
 bool set_model(size_t i, DarkSunParameters &params) {
   if (i < NUM_CS * NUM_N) {
     int idx_n = i % NUM_N;
@@ -46,11 +40,6 @@ bool set_model(size_t i, DarkSunParameters &params) {
     params.xi_inf = XI_INF;
     params.lam = LAM;
 
-    {
-      std::lock_guard<std::mutex> lock(progress_mutex);
-      ++progress;
-    }
-
     return false;
   } else {
     return true;
@@ -58,6 +47,6 @@ bool set_model(size_t i, DarkSunParameters &params) {
 }
 
 int main() {
-  Scanner s(FNAME, set_model);
+  Scanner s(FNAME, set_model, NUM_N * NUM_CS);
   s.scan();
 }
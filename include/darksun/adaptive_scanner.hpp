@@ -0,0 +1,254 @@
+#ifndef DARKSUN_ADAPTIVE_SCANNER_HPP
+#define DARKSUN_ADAPTIVE_SCANNER_HPP
+
+#include "darksun/result_sink.hpp"
+#include "darksun/scanner.hpp"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace darksun {
+
+// Range and number of coarse grid points along one axis of an adaptive scan
+struct ScanAxis {
+  double min;
+  double max;
+  size_t num;
+};
+
+// Sets up the model at the point (x, y) of an adaptive scan
+using PointSetter = std::function<void(double, double, DarkSunParameters &)>;
+// Function whose zero level set is resolved by an adaptive scan
+using ContourFunction = std::function<double(const DarkSunParameters &)>;
+
+/**
+ * @brief Two-dimensional scan which concentrates points near contours.
+ *
+ * The scan starts from a coarse grid with `x_axis.num` by `y_axis.num`
+ * points. Every cell of the grid in which one of the `contours` changes sign
+ * between the corners is split into four, and the new corners are computed.
+ * This is repeated `max_level` times, so the contours are resolved as if the
+ * scan had been performed on a uniform grid with 2^max_level times as many
+ * points along each axis, at a small fraction of the cost. Failed points
+ * (NaN contour values) are ignored when deciding whether to refine a cell. A
+ * contour entering and leaving a cell through the same edge is not seen, as
+ * with any grid-based contour finder at the same resolution.
+ *
+ * Each level is computed in parallel with a `Scanner`. All points are
+ * written to a CSV file in the order in which they are completed.
+ */
+class AdaptiveScanner {
+public:
+  const std::string file_name;
+  ScanAxis x_axis;
+  ScanAxis y_axis;
+  PointSetter set_point;
+  std::vector<ContourFunction> contours;
+  // Number of times the cells crossing a contour are refined
+  size_t max_level;
+  // Number of threads. See `Scanner::num_threads`.
+  size_t num_threads = 0;
+  // If true, display a progress bar for each level.
+  bool show_progress = true;
+  // If true, time the phases of the Boltzmann solver. See
+  // `Scanner::time_solver`.
+  bool time_solver = false;
+  // Function computing the derived quantities of each model. See
+  // `Scanner::solve_model`.
+  ModelSolver solve_model = [](DarkSunParameters &params) {
+    solve_boltzmann(1e-7, 1e-7, params);
+  };
+
+  AdaptiveScanner(const std::string &t_file_name, ScanAxis t_x_axis,
+                  ScanAxis t_y_axis, PointSetter t_set_point,
+                  std::vector<ContourFunction> t_contours,
+                  size_t t_max_level = 4)
+      : file_name(t_file_name), x_axis(t_x_axis), y_axis(t_y_axis),
+        set_point(std::move(t_set_point)), contours(std::move(t_contours)),
+        max_level(t_max_level) {}
+
+  void scan();
+
+  /// Number of points computed by the last scan.
+  size_t num_evaluations() const { return values.size(); }
+
+  /**
+   * @brief Returns true if the point (i, j) of the finest grid, with
+   * (x_axis.num - 1) * 2^max_level + 1 points along x and similarly along y,
+   * was computed by the last scan.
+   */
+  bool is_evaluated(size_t i, size_t j) const {
+    return values.count(key(i, j)) > 0;
+  }
+
+private:
+  // Location of a grid point on the finest grid
+  using Node = std::pair<size_t, size_t>;
+  // Cell of the grid with lower-left corner (i, j) and side `size`, in units
+  // of the spacing of the finest grid
+  struct Cell {
+    size_t i;
+    size_t j;
+    size_t size;
+  };
+
+  // Number of points of the finest grid along each axis
+  size_t nx_fine = 0;
+  size_t ny_fine = 0;
+  // Values of the contour functions at the computed points
+  std::unordered_map<uint64_t, std::vector<double>> values;
+
+  uint64_t key(size_t i, size_t j) const { return uint64_t(i) * ny_fine + j; }
+
+  bool crosses_contour(const Cell &cell) const;
+  void evaluate(const std::vector<Node> &nodes, ResultSink &sink,
+                size_t &offset);
+};
+
+/**
+ * @brief Sink recording the contour values of the points of one level of an
+ * adaptive scan and forwarding the results to the output file.
+ */
+class ContourRecordingSink final : public ResultSink {
+public:
+  ContourRecordingSink(ResultSink &out, size_t offset,
+                       const std::vector<ContourFunction> &contours,
+                       std::vector<std::vector<double>> &values)
+      : out(out), offset(offset), contours(contours), values(values) {}
+
+  void write(size_t worker, size_t idx,
+             const DarkSunParameters &params) override {
+    auto &vals = values[idx];
+    vals.resize(contours.size());
+    for (size_t k = 0; k < contours.size(); k++) {
+      vals[k] = contours[k](params);
+    }
+    out.write(worker, offset + idx, params);
+  }
+
+  void close() override {}
+
+private:
+  ResultSink &out;
+  size_t offset;
+  const std::vector<ContourFunction> &contours;
+  std::vector<std::vector<double>> &values;
+};
+
+bool AdaptiveScanner::crosses_contour(const Cell &cell) const {
+  const std::array<Node, 4> corners = {
+      Node{cell.i, cell.j}, Node{cell.i + cell.size, cell.j},
+      Node{cell.i, cell.j + cell.size},
+      Node{cell.i + cell.size, cell.j + cell.size}};
+  for (size_t k = 0; k < contours.size(); k++) {
+    bool has_neg = false;
+    bool has_pos = false;
+    for (const auto &corner : corners) {
+      const double val = values.at(key(corner.first, corner.second))[k];
+      has_neg = has_neg || val < 0.0;
+      has_pos = has_pos || val >= 0.0;
+    }
+    if (has_neg && has_pos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void AdaptiveScanner::evaluate(const std::vector<Node> &nodes,
+                               ResultSink &sink, size_t &offset) {
+  if (nodes.empty()) {
+    return;
+  }
+  const double dx = (x_axis.max - x_axis.min) / double(nx_fine - 1);
+  const double dy = (y_axis.max - y_axis.min) / double(ny_fine - 1);
+  auto set_model = [&](size_t idx, DarkSunParameters &params) {
+    if (idx >= nodes.size()) {
+      return true;
+    }
+    set_point(x_axis.min + dx * double(nodes[idx].first),
+              y_axis.min + dy * double(nodes[idx].second), params);
+    return false;
+  };
+  Scanner scanner(file_name, set_model, nodes.size(), num_threads);
+  scanner.show_progress = show_progress;
+  scanner.time_solver = time_solver;
+  scanner.solve_model = solve_model;
+
+  std::vector<std::vector<double>> level_values(nodes.size());
+  ContourRecordingSink recorder(sink, offset, contours, level_values);
+  scanner.scan(recorder);
+  for (size_t n = 0; n < nodes.size(); n++) {
+    values[key(nodes[n].first, nodes[n].second)] = std::move(level_values[n]);
+  }
+  offset += nodes.size();
+}
+
+void AdaptiveScanner::scan() {
+  if (x_axis.num < 2 || y_axis.num < 2) {
+    throw std::invalid_argument(
+        "AdaptiveScanner: each axis needs at least two points");
+  }
+  const size_t stride = size_t(1) << max_level;
+  nx_fine = (x_axis.num - 1) * stride + 1;
+  ny_fine = (y_axis.num - 1) * stride + 1;
+  values.clear();
+
+  const size_t nthreads =
+      Scanner(file_name, nullptr, 0, num_threads).get_num_threads();
+  CsvResultSink sink(file_name, nthreads);
+  size_t offset = 0;
+
+  // Coarse grid
+  std::vector<Node> nodes;
+  std::vector<Cell> cells;
+  for (size_t a = 0; a < x_axis.num; a++) {
+    for (size_t b = 0; b < y_axis.num; b++) {
+      nodes.emplace_back(a * stride, b * stride);
+      if (a + 1 < x_axis.num && b + 1 < y_axis.num) {
+        cells.push_back(Cell{a * stride, b * stride, stride});
+      }
+    }
+  }
+  evaluate(nodes, sink, offset);
+
+  // Refine the cells crossing a contour
+  for (size_t level = 1; level <= max_level && !cells.empty(); level++) {
+    std::vector<Cell> children;
+    std::unordered_set<uint64_t> queued;
+    nodes.clear();
+    for (const auto &cell : cells) {
+      if (!crosses_contour(cell)) {
+        continue;
+      }
+      const size_t h = cell.size / 2;
+      for (size_t a = 0; a <= 2; a++) {
+        for (size_t b = 0; b <= 2; b++) {
+          const size_t i = cell.i + a * h;
+          const size_t j = cell.j + b * h;
+          const uint64_t k = key(i, j);
+          if (values.count(k) == 0 && queued.insert(k).second) {
+            nodes.emplace_back(i, j);
+          }
+          if (a < 2 && b < 2) {
+            children.push_back(Cell{i, j, h});
+          }
+        }
+      }
+    }
+    evaluate(nodes, sink, offset);
+    cells = std::move(children);
+  }
+  sink.close();
+}
+
+} // namespace darksun
+
+#endif // DARKSUN_ADAPTIVE_SCANNER_HPP
@@ -10,7 +10,9 @@
 #include "darksun/model/cross_sections.hpp"
 #include "darksun/model/dneff.hpp"
 #include "darksun/model/parameters.hpp"
+#include "darksun/model/relic_estimate.hpp"
 #include "darksun/model/scaled_eta_cross_section.hpp"
+#include "darksun/model/thermal_cross_section_table.hpp"
 #include "darksun/model/thermal_functions.hpp"
 
 #endif // DARKSUN_DARKSUN_HPP
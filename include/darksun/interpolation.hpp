@@ -0,0 +1,149 @@
+#ifndef DARKSUN_INTERPOLATION_HPP
+#define DARKSUN_INTERPOLATION_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace darksun {
+
+/**
+ * @brief Compute the coefficients of the natural cubic spline through the
+ * uniformly spaced points `ys[0], ..., ys[num - 1]`.
+ *
+ * Entry i holds the coefficients {a0, a1, a2, a3} of the cubic
+ * a0 + a1 u + a2 u^2 + a3 u^3 on interval i, where u = (x - x[i]) / h.
+ */
+std::vector<std::array<double, 4>>
+natural_cubic_spline_coefficients(const double *ys, size_t num) {
+  // Solve the tridiagonal system for the second derivatives (times h^2 / 6)
+  //     m[i-1] + 4 m[i] + m[i+1] = y[i+1] - 2 y[i] + y[i-1]
+  // with m[0] = m[num-1] = 0 using the Thomas algorithm.
+  std::vector<double> m(num, 0.0);
+  std::vector<double> c(num, 0.0);
+  for (size_t i = 1; i < num - 1; i++) {
+    const double rhs = ys[i + 1] - 2.0 * ys[i] + ys[i - 1];
+    const double den = 4.0 - c[i - 1];
+    c[i] = 1.0 / den;
+    m[i] = (rhs - m[i - 1]) / den;
+  }
+  for (size_t i = num - 2; i > 0; i--) {
+    m[i] -= c[i] * m[i + 1];
+  }
+  std::vector<std::array<double, 4>> coeffs(num - 1);
+  for (size_t i = 0; i < num - 1; i++) {
+    coeffs[i][0] = ys[i];
+    coeffs[i][1] = ys[i + 1] - ys[i] - 2.0 * m[i] - m[i + 1];
+    coeffs[i][2] = 3.0 * m[i];
+    coeffs[i][3] = m[i + 1] - m[i];
+  }
+  return coeffs;
+}
+
+/**
+ * @brief Set of M natural cubic splines through data on a common uniform
+ * grid.
+ *
+ * Each spline is identical to GSL's `gsl_interp_cspline` (natural boundary
+ * conditions), but since the grid is uniform, the interval containing a point
+ * is found with index arithmetic rather than a search. The interval index is
+ * shared between the M splines and their coefficients are stored
+ * contiguously, so evaluating all of them costs little more than evaluating
+ * one. The coefficients are computed once at construction and never
+ * modified, so the splines can be evaluated concurrently from any number of
+ * threads without accelerators or locks.
+ */
+template <size_t M> class UniformCubicSplineArray {
+public:
+  /**
+   * @brief Construct the splines through the points
+   * (x_min + i * x_step, ys[j][i]) for i = 0, ..., num - 1.
+   *
+   * @param x_min Location of the first grid point.
+   * @param x_step Spacing between grid points.
+   * @param ys Values of the M functions at the grid points.
+   * @param num Number of grid points. Must be at least 3.
+   */
+  UniformCubicSplineArray(double x_min, double x_step,
+                          const std::array<const double *, M> &ys, size_t num)
+      : p_x_min(x_min), p_x_max(x_min + x_step * double(num - 1)),
+        p_inv_step(1.0 / x_step), p_coeffs(num - 1) {
+    for (size_t j = 0; j < M; j++) {
+      const auto coeffs = natural_cubic_spline_coefficients(ys[j], num);
+      for (size_t i = 0; i < num - 1; i++) {
+        p_coeffs[i][j] = coeffs[i];
+      }
+    }
+  }
+
+  /// Lower bound of the interpolation range.
+  double x_min() const { return p_x_min; }
+  /// Upper bound of the interpolation range.
+  double x_max() const { return p_x_max; }
+
+  /**
+   * @brief Evaluate all of the splines. Points outside [x_min, x_max] are
+   * evaluated using the polynomials of the first or last interval.
+   */
+  std::array<double, M> operator()(double x) const {
+    double u;
+    const auto &as = p_coeffs[locate(x, u)];
+    std::array<double, M> res;
+    for (size_t j = 0; j < M; j++) {
+      res[j] = as[j][0] + u * (as[j][1] + u * (as[j][2] + u * as[j][3]));
+    }
+    return res;
+  }
+
+  /// Evaluate the j'th spline.
+  double operator()(double x, size_t j) const {
+    double u;
+    const auto &a = p_coeffs[locate(x, u)][j];
+    return a[0] + u * (a[1] + u * (a[2] + u * a[3]));
+  }
+
+private:
+  double p_x_min;
+  double p_x_max;
+  double p_inv_step;
+  std::vector<std::array<std::array<double, 4>, M>> p_coeffs;
+
+  // Find the interval containing x and the location of x within the interval
+  size_t locate(double x, double &u) const {
+    const double t = (x - p_x_min) * p_inv_step;
+    const auto last = double(p_coeffs.size() - 1);
+    const double ti = std::clamp(std::floor(t), 0.0, last);
+    u = t - ti;
+    return size_t(ti);
+  }
+};
+
+/**
+ * @brief Natural cubic spline through data on a uniform grid. See
+ * `UniformCubicSplineArray`.
+ */
+class UniformCubicSpline {
+public:
+  UniformCubicSpline(double x_min, double x_step, const double *ys, size_t num)
+      : p_spline(x_min, x_step, {ys}, num) {}
+
+  /// Lower bound of the interpolation range.
+  double x_min() const { return p_spline.x_min(); }
+  /// Upper bound of the interpolation range.
+  double x_max() const { return p_spline.x_max(); }
+
+  /**
+   * @brief Evaluate the spline. Points outside [x_min, x_max] are evaluated
+   * using the polynomial of the first or last interval.
+   */
+  double operator()(double x) const { return p_spline(x, 0); }
+
+private:
+  UniformCubicSplineArray<1> p_spline;
+};
+
+} // namespace darksun
+
+#endif // DARKSUN_INTERPOLATION_HPP
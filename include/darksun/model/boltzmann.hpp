@@ -6,7 +6,9 @@
 #include "darksun/model/cross_sections.hpp"
 #include "darksun/model/dneff.hpp"
 #include "darksun/model/parameters.hpp"
+#include "darksun/model/thermal_cross_section_table.hpp"
 #include "darksun/model/thermal_functions.hpp"
+#include <array>
 #include <fmt/core.h>
 #include <gsl/gsl_errno.h>
 #include <stiff/stiff.hpp>
@@ -14,115 +16,209 @@
 namespace darksun {
 
 //===========================================================================
-//---- RHS of the Boltzmann -------------------------------------------------
+//---- Thermodynamic state entering the Boltzmann ---------------------------
 //===========================================================================
 
-void boltzmann(int *, double *t, double *y, double *dy,
-               const DarkSunParameters &params) {
+/**
+ * @brief Clear the cache of thermodynamic states stored in `params`. Must be
+ * called whenever something changes the state at fixed log(x), e.g. setting
+ * the freeze-out temperature.
+ */
+void clear_boltzmann_state(const DarkSunParameters &params) {
+  for (auto &state : params.state_cache) {
+    state.logx = NAN;
+  }
+  params.state_cache_idx = 0;
+}
+
+/**
+ * @brief Compute the thermodynamic state at `logx` needed by the RHS and
+ * Jacobian of the Boltzmann equation.
+ *
+ * The result is cached in `params`, so that the RHS and Jacobian at the same
+ * point, as well as repeated RHS evaluations at the same stage times during
+ * the Newton iterations, only compute xi, the entropy density, the
+ * equilibrium abundance and the thermal cross-sections once.
+ */
+const BoltzmannState &boltzmann_state(const double logx,
+                                      const DarkSunParameters &params) {
+  for (const auto &state : params.state_cache) {
+    if (state.logx == logx) {
+      return state;
+    }
+  }
+
+  auto &state = params.state_cache[params.state_cache_idx];
+  params.state_cache_idx =
+      (params.state_cache_idx + 1) % DarkSunParameters::STATE_CACHE_SIZE;
 
-  const double x = exp(*t);
+  const double x = exp(logx);
   const double meta = m_eta(params);
   const double tsm = meta / x;
-  const double we = y[0]; // log(Yeta)
 
   const double xi = compute_xi_const_tsm(tsm, params);
   const double td = xi * tsm;
   const double s = StandardModel::entropy_density(tsm);
-  const double we_eq = weq_eta(tsm, xi, params);
 
-  const double sige = thermal_cross_section_4eta_2eta(meta / td, params);
+  const double sige =
+      tabulated_thermal_cross_section_4eta_2eta(meta / td, params);
   const double sigd = thermal_cross_section_2eta_2del(meta / td, params);
 
+  // Degrees of freedom and equilibrium abundance from one set of Bessel
+  // functions
+  const auto thermo = dark_thermodynamics(tsm, xi, params);
   const double com =
-      sqrt(M_PI / 45) * M_PLANK * sqrt_gstar(tsm, xi, params) * tsm;
-  const double pfe = -s * s * com;
-  const double pfd = com;
+      sqrt(M_PI / 45) * M_PLANK * sqrt_gstar(tsm, xi, thermo) * tsm;
+
+  state.logx = logx;
+  state.tsm = tsm;
+  state.xi = xi;
+  state.we_eq = thermo.weq_eta;
+  state.fe = -s * s * com * sige;
+  state.fd = com * sigd;
 
-  dy[0] = pfe * sige * exp(we) * (exp(2 * we) - exp(2 * we_eq));
-  dy[1] = pfd * sigd * exp(2 * we);
+  return state;
 }
 
 //===========================================================================
-//---- Jacobian RHS of the Boltzmann ----------------------------------------
+//---- RHS of the Boltzmann -------------------------------------------------
 //===========================================================================
 
-void boltzmann_jac(int *, double *t, double *y, double *dfy, int *,
-                   const DarkSunParameters &params) {
-
-  const double x = exp(*t);
-  const double meta = m_eta(params);
-  const double tsm = meta / x;
-  const double we = y[0]; // log(Yeta)
+// State vector (log(Y_eta), Y_del) of the Boltzmann equations and its Jacobian
+using BoltzmannVector = std::array<double, 2>;
+using BoltzmannMatrix = std::array<BoltzmannVector, 2>;
+
+/**
+ * @brief RHS of the Boltzmann equations for the state `y` at the
+ * thermodynamic state `state`.
+ *
+ * Templated on the scalar type so that the Jacobian is obtained from this
+ * single code path by automatic differentiation, see `boltzmann_jac`. New
+ * terms only need to be added here.
+ */
+template <class T>
+void boltzmann_rhs(const std::array<T, 2> &y, std::array<T, 2> &dy,
+                   const BoltzmannState &state) {
+  const T &we = y[0]; // log(Yeta)
+
+  dy[0] = state.fe * exp(we) * (exp(2 * we) - exp(2 * state.we_eq));
+  dy[1] = state.fd * exp(2 * we);
+}
 
-  const double xi = compute_xi_const_tsm(tsm, params);
-  const double td = xi * tsm;
-  const double s = StandardModel::entropy_density(tsm);
-  const double we_eq = weq_eta(tsm, xi, params);
+void boltzmann(double logx, const BoltzmannVector &y, BoltzmannVector &dy,
+               const DarkSunParameters &params) {
+  boltzmann_rhs(y, dy, boltzmann_state(logx, params));
+}
 
-  const double sige = thermal_cross_section_4eta_2eta(meta / td, params);
-  const double sigd = thermal_cross_section_2eta_2del(meta / td, params);
+//===========================================================================
+//---- Jacobian RHS of the Boltzmann ----------------------------------------
+//===========================================================================
 
-  const double com =
-      sqrt(M_PI / 45) * M_PLANK * sqrt_gstar(tsm, xi, params) * tsm;
-  const double pfe = com * (-s * s);
-  const double pfd = com;
-
-  // dfe / dWe
-  dfy[0] = pfe * sige * exp(we) * (3.0 * exp(2 * we) - exp(2 * we_eq));
-  // dfe / dYe
-  dfy[1] = 0.0;
-  // dfd / dWe
-  dfy[2] = 2.0 * pfd * sigd * exp(2 * we);
-  // dfd / dYd
-  dfy[3] = 0.0;
+/**
+ * @brief Jacobian dfy[i][j] = df_i/dy_j of the Boltzmann equations,
+ * computed from `boltzmann_rhs` by forward-mode automatic differentiation.
+ */
+void boltzmann_jac(double logx, const BoltzmannVector &y, BoltzmannMatrix &dfy,
+                   const DarkSunParameters &params) {
+  const auto &state = boltzmann_state(logx, params);
+  stiff::jacobian<2>(
+      [&state](double, const auto &y, auto &dy) {
+        boltzmann_rhs(y, dy, state);
+      },
+      logx, y, dfy);
 }
 
 //===========================================================================
 //---- solution output ------------------------------------------------------
 //===========================================================================
 
-void solout(int *nr, double *logxold, double *logx, double *y, double *cont,
-            int *lrc, int *, DarkSunParameters &params, int *,
-            const stiff::RadauWeight &w) {
-
-  // Determine if the eta' has frozen out
-  const double x = exp(*logx);
-  const double meta = m_eta(params);
-  const double tsm = meta / x;
-  const double we = y[0];
-  const double xi = compute_xi_const_tsm(tsm, params);
-  const double we_eq = weq_eta(tsm, xi, params);
-  if (we - we_eq > 0.1 && params.xi_fo < 0.0) {
-    params.xi_fo = xi;
-    params.tsm_fo = tsm;
+/**
+ * @brief Sample the solution after an accepted step from `logxold` to
+ * `logx` as requested by `params.output` and locate the freeze-out of the
+ * eta'. `dense(i, logx)` evaluates the
+ * dense output of component `i` of the solution over the step.
+ */
+template <class Dense>
+bool solout(int nr, double logxold, double logx, const BoltzmannVector &y,
+            const Dense &dense, DarkSunParameters &params) {
+
+  // Determine if the eta' has frozen out, i.e. log(Y_eta) has departed from
+  // its equilibrium value by 0.1. The event fires once, after which xi is
+  // computed by redshifting and the cached states are stale.
+  auto departure = [&](double lx) {
+    return dense(0, lx) - boltzmann_state(lx, params).we_eq - 0.1;
+  };
+  if (params.freeze_out.check(logxold, logx, departure)) {
+    const auto &state = boltzmann_state(params.freeze_out.location(), params);
+    params.xi_fo = state.xi;
+    params.tsm_fo = state.tsm;
+    clear_boltzmann_state(params);
   }
 
-  double dx = params.dlogx;
-  double d = params.logx;
-  int i = params.sol_idx;
-  if (*nr == 1) {
-    d = *logxold;
+  switch (params.output) {
+  case SolutionOutput::None:
+    break;
+  case SolutionOutput::Endpoints:
+    // The final state is recorded by `finish_boltzmann`
+    if (nr == 1) {
+      params.ts.push_back(logxold);
+      params.ys.push_back({dense(0, logxold), dense(1, logxold)});
+    }
+    break;
+  case SolutionOutput::Grid: {
+    const auto &grid = params.output_logx;
+    size_t &i = params.output_idx;
+    for (; i < grid.size() && grid[i] <= logx; i++) {
+      if (grid[i] >= logxold) {
+        params.ts.push_back(grid[i]);
+        params.ys.push_back({dense(0, grid[i]), dense(1, grid[i])});
+      }
+    }
+    break;
   }
-  while ((*logxold <= d) && (*logx >= d)) {
-    int idx1 = 1, idx2 = 2;
-    params.ts[i] = d;
-    params.ys[i][0] = contra(&idx1, &d, cont, lrc, w);
-    params.ys[i][1] = contra(&idx2, &d, cont, lrc, w);
-
-    d += dx;
-    i += 1;
+  case SolutionOutput::Callback:
+    // Every integrator reports its initial state with logxold == logx, which
+    // is only passed on for the first of them
+    if (nr == 1 || logxold != logx) {
+      params.output_callback(logx, y);
+    }
+    break;
   }
-  params.sol_idx = i;
-  params.logx = d;
+  return true;
 }
 
 //===========================================================================
 //---- Solve the Boltzmann --------------------------------------------------
 //===========================================================================
 
-void solve_boltzmann(double reltol, double abstol, DarkSunParameters &params) {
-  using namespace stiff;
+/**
+ * @brief Set the derived quantities of `params` to NaN, marking a model whose
+ * Boltzmann equations could not be solved.
+ */
+void set_results_nan(DarkSunParameters &params) {
+  params.xi_fo = NAN;
+  params.tsm_fo = NAN;
+  params.rd_eta = NAN;
+  params.rd_del = NAN;
+  params.xi_cmb = NAN;
+  params.xi_bbn = NAN;
+  params.dneff_cmb = NAN;
+  params.dneff_bbn = NAN;
+  params.eta_si_per_mass = NAN;
+  params.del_si_per_mass = NAN;
+}
 
+/**
+ * @brief Prepare `params` for solving the Boltzmann equations: tabulate xi
+ * and the thermal cross-sections over the integration range and compute the
+ * initial conditions.
+ *
+ * @param start Set to the initial log(x), with x = m_eta / T_SM.
+ * @param final Set to the final log(x), at the CMB.
+ * @param y Set to the initial state.
+ */
+void setup_boltzmann(DarkSunParameters &params, double &start, double &final,
+                     BoltzmannVector &y) {
   // Initial conditions
   double meta = m_eta(params);
 
@@ -130,104 +226,209 @@ void solve_boltzmann(double reltol, double abstol, DarkSunParameters &params) {
   double td = params.lam / 2.0;                // Start Td at confinement
   double xi = compute_xi_const_td(td, params); // Starting value of xi
   double tsm = td / xi;                        // Initial SM temperature
-  double start = log(meta / tsm);
-  double final = log(meta / T_CMB);
-  params.dlogx = (final - start) / double(DarkSunParameters::SOL_LENGTH - 1);
+  start = log(meta / tsm);
+  final = log(meta / T_CMB);
+
+  // Tabulate xi over the entire integration range so we don't need to perform
+  // root-finding on every call to the RHS.
+  tabulate_xi_const_tsm(T_CMB, tsm, params);
+  clear_boltzmann_state(params);
+  // The eta' has not frozen out yet
+  params.xi_fo = -1.0;
+  params.tsm_fo = -1.0;
+  params.freeze_out.reset();
+  params.ts.clear();
+  params.ys.clear();
+  params.output_idx = 0;
 
   // Initial conditions : y[0] = log(Y_eta), y[1] = Y_del
-  constexpr int ndim = 2;
-  double y[ndim];
   y[0] = weq_eta(tsm, xi, params);
   y[1] = 0.0; // exp(-params.adel * params.n) * yeq_del(tsm, xi, params);
+}
 
-  //==================================================================
-  //---- Set RADAU scalar parameters ---------------------------------
-  //==================================================================
-  int nd = ndim;        // dimension of the system
-  int ns = 9;           // maximum number of allowed stages
-  int ijac = 1;         // analytic jacobian
-  int mljac = ndim;     // full Jacaobian
-  int mujac = 0;        // full Jacaobian
-  int imas = 0;         // no mass matrix
-  int mlmas = 0;        // no mass matrix
-  int mumas = 0;        // no mass matrix
-  int idid{};           // Flag for radau return code
-  double rtol = reltol; // Relative tolerance for radau
-  double atol = abstol; // Absolute tolerance for radau
-  int itol = 0;         // Flag telling radau we are using scalar tols
-  double h = 1.0e-6;    // Initial step size
-  int iout = 1;         // Have radau call `solout`
-  int ipar = 0;         // Counter for specifying solution index
-  int lwork = (ns + 1) * nd * nd + (3 * ns + 3) * nd + 20;
-  int liwork = (2 + (ns - 1) / 2) * nd + 20;
+/**
+ * @brief Record the outputs of the Boltzmann solver in `params`, given its
+ * return code `idid` and the state `y` at `final`.
+ */
+void finish_boltzmann(int idid, double final, const BoltzmannVector &y,
+                      DarkSunParameters &params) {
+  // If 'idid' > 0, that means that RADAU was successful. Otherwise,
+  // there was an error
+  if (idid > 0) {
+    if (params.output == SolutionOutput::Endpoints) {
+      params.ts.push_back(final);
+      params.ys.push_back(y);
+    }
 
+    params.rd_eta = m_eta(params) * exp(y[0]) * S_TODAY / RHO_CRIT;
+    params.rd_del = m_del(params) * y[1] * S_TODAY / RHO_CRIT;
+    params.xi_cmb = compute_xi_const_tsm(T_CMB, params);
+    params.xi_bbn = compute_xi_const_tsm(T_BBN, params);
+    params.dneff_cmb = compute_dneff_bbn(params);
+    params.dneff_bbn = compute_dneff_bbn(params);
+    params.eta_si_per_mass = cross_section_2eta_2eta(params) / m_eta(params);
+    params.del_si_per_mass = cross_section_2del_2del(params) / m_del(params);
+  } else {
+    set_results_nan(params);
+  }
+}
+
+/**
+ * @brief State of the integration of the Boltzmann equations, carried over
+ * from one integrator to the next when switching between them.
+ */
+struct BoltzmannIntegration {
+  double reltol;
+  double abstol;
+  double logx = 0.0;  // Current log(x)
+  double final = 0.0; // Final log(x)
+  BoltzmannVector y{};
+  double h = 1.0e-6; // Next step size
+  // Number of steps accepted by earlier integrators. Added to the step
+  // numbers passed to `solout`, so that a later integrator continues the
+  // output of the previous one instead of restarting it.
+  int num_steps = 0;
+};
+
+/**
+ * @brief Integrate the Boltzmann equations of `params` with the implicit
+ * `Solver`, which is `stiff::Radau5<2>` or `stiff::Rodas<2>`.
+ *
+ * If `handoff` is true, the integration stops with return code 2 as soon as
+ * the eta' has frozen out and the last step lies within the stability
+ * region of an explicit method, i.e. h * |df_eta/dW_eta| < 1.
+ *
+ * @return The return code of the solver.
+ */
+template <class Solver>
+int integrate_boltzmann(BoltzmannIntegration &integ, bool handoff,
+                        DarkSunParameters &params) {
   //==================================================================
-  //---- Set RADAU array parameters ----------------------------------
+  //---- Set solver parameters ---------------------------------------
   //==================================================================
-  std::vector<double> work(lwork); // Workspace of doubles needed for radau
-  std::vector<int> iwork(liwork);  // Workspace of ints needed for radau
-  for (int i = 0; i < 20; i++) {   // Set all radau params to defaults
-    iwork[i] = 0;
-    work[i] = 0.0;
-  }
-  work[6] = 1e-2; // Set maximum step size to 0.01
+  Solver solver;
+  solver.rtol = integ.reltol; // Relative tolerance
+  solver.atol = integ.abstol; // Absolute tolerance
+  solver.hmax = 1e-2;         // Maximum step size
+  solver.timing = params.time_solver;
 
   //==================================================================
   //---- Define lambdas which capture the model ----------------------
   //==================================================================
-  auto boltz = [&params, &ipar](int *n, double *logx, double *y, double *dy) {
-    boltzmann(n, logx, y, dy, params);
+  auto boltz = [&params](double logx, const BoltzmannVector &y,
+                         BoltzmannVector &dy) {
+    boltzmann(logx, y, dy, params);
   };
-  auto jac = [&params, &ipar](int *n, double *logx, double *y, double *dfy,
-                              int *ldfy) {
-    boltzmann_jac(n, logx, y, dfy, ldfy, params);
+  auto jac = [&params](double logx, const BoltzmannVector &y,
+                       BoltzmannMatrix &dfy) {
+    boltzmann_jac(logx, y, dfy, params);
   };
-  auto mas = [](int *, double *, int *) {};
-  auto solo = [&params, &ipar](int *nr, double *xold, double *x, double *y,
-                               double *cont, int *lrc, int *n, int *irtrn,
-                               const RadauWeight &w) {
-    solout(nr, xold, x, y, cont, lrc, n, params, irtrn, w);
+  auto solo = [&params, &integ, handoff](int nr, double logxold, double logx,
+                                         const BoltzmannVector &y,
+                                         const Solver &solver) {
+    auto dense = [&solver](size_t i, double x) { return solver.dense(i, x); };
+    if (!solout(nr + integ.num_steps, logxold, logx, y, dense, params)) {
+      return false;
+    }
+    if (!handoff || !(params.xi_fo >= 0.0) || nr == 1) {
+      return true;
+    }
+    BoltzmannMatrix dfy;
+    boltzmann_jac(logx, y, dfy, params);
+    return std::abs(solver.get_h() * dfy[0][0]) >= 1.0;
   };
 
   //==================================================================
-  //---- Solve the Boltzmann equations using RADAU -------------------
+  //---- Solve the Boltzmann equations -------------------------------
   //==================================================================
-  radau(&nd, boltz, &start, y, &final, &h, &rtol, &atol, &itol, jac, &ijac,
-        &mljac, &mujac, mas, &imas, &mlmas, &mumas, solo, &iout, work.data(),
-        &lwork, iwork.data(), &liwork, &idid);
+  const int idid =
+      solver.integrate(boltz, jac, integ.logx, integ.y, integ.final, integ.h,
+                       solo);
+  integ.num_steps += solver.stats.naccpt;
+  params.solver_stats += solver.stats;
+  return idid;
+}
+
+/**
+ * @brief Integrate the Boltzmann equations of `params` with the explicit
+ * DOPRI5, until the end or until the system is found to be stiff, in which
+ * case the return code is -4.
+ */
+int integrate_boltzmann_explicit(BoltzmannIntegration &integ,
+                                 DarkSunParameters &params) {
+  stiff::Dopri5<2> solver;
+  solver.rtol = integ.reltol;
+  solver.atol = integ.abstol;
+  solver.hmax = 1e-1;
+  solver.nstiff = 1;
+  solver.timing = params.time_solver;
+
+  auto boltz = [&params](double logx, const BoltzmannVector &y,
+                         BoltzmannVector &dy) {
+    boltzmann(logx, y, dy, params);
+  };
+  auto solo = [&params, &integ](int nr, double logxold, double logx,
+                                const BoltzmannVector &y,
+                                const stiff::Dopri5<2> &solver) {
+    auto dense = [&solver](size_t i, double x) { return solver.dense(i, x); };
+    return solout(nr + integ.num_steps, logxold, logx, y, dense, params);
+  };
+
+  const int idid =
+      solver.integrate(boltz, integ.logx, integ.y, integ.final, integ.h, solo);
+  integ.num_steps += solver.stats.naccpt;
+  params.solver_stats += solver.stats;
+  return idid;
+}
+
+/**
+ * @brief Solve the Boltzmann equations of `params` with the integrator
+ * selected by `params.solver` and record the derived quantities.
+ *
+ * Both integrators are specialized to the two-dimensional system, with
+ * closed-form linear solves and no heap allocation: `Radau5` is the
+ * fifth-order implicit Runge-Kutta method and `Rodas` the fourth-order
+ * Rosenbrock method, which needs a single decomposition and no Newton
+ * iterations per step.
+ *
+ * If `params.stiffness_switching` is set, the implicit integrator hands over
+ * to DOPRI5 once the eta' has frozen out and the system is no longer stiff.
+ * Should DOPRI5 find the system stiff again, the implicit integrator takes
+ * over until the next hand-off.
+ */
+void solve_boltzmann(double reltol, double abstol, DarkSunParameters &params) {
+  BoltzmannIntegration integ{reltol, abstol};
+  double start;
+  setup_boltzmann(params, start, integ.final, integ.y);
+  integ.logx = start;
+  params.solver_stats = stiff::SolverStats{};
+
+  const bool handoff = params.stiffness_switching;
+  int idid;
+  while (true) {
+    if (params.solver == BoltzmannSolver::Rodas) {
+      idid = integrate_boltzmann<stiff::Rodas<2>>(integ, handoff, params);
+    } else {
+      idid = integrate_boltzmann<stiff::Radau5<2>>(integ, handoff, params);
+    }
+    if (!handoff || idid != 2) {
+      break;
+    }
+    // The hand-off may coincide with the end of the integration
+    if (std::abs(integ.final - integ.logx) <= 1e-10 * std::abs(integ.final)) {
+      idid = 1;
+      break;
+    }
+    idid = integrate_boltzmann_explicit(integ, params);
+    if (idid != -4) {
+      break;
+    }
+  }
 
   //==================================================================
   //---- Record/Calculate outputs ------------------------------------
   //==================================================================
-  // If 'idid' > 0, that means that RADAU was successful. Otherwise,
-  // there was an error
-  if (idid > 0) {
-    // Save last state
-    constexpr size_t last_idx = DarkSunParameters::SOL_LENGTH - 1;
-    params.ts[last_idx] = final;
-    params.ys[last_idx][0] = y[0];
-    params.ys[last_idx][1] = y[1];
-
-    params.rd_eta = m_eta(params) * exp(y[0]) * S_TODAY / RHO_CRIT;
-    params.rd_del = m_del(params) * y[1] * S_TODAY / RHO_CRIT;
-    params.xi_cmb = compute_xi_const_tsm(T_CMB, params);
-    params.xi_bbn = compute_xi_const_tsm(T_BBN, params);
-    params.dneff_cmb = compute_dneff_bbn(params);
-    params.dneff_bbn = compute_dneff_bbn(params);
-    params.eta_si_per_mass = cross_section_2eta_2eta(params) / m_eta(params);
-    params.del_si_per_mass = cross_section_2del_2del(params) / m_del(params);
-  } else {
-    params.xi_fo = NAN;
-    params.tsm_fo = NAN;
-    params.rd_eta = NAN;
-    params.rd_del = NAN;
-    params.xi_cmb = NAN;
-    params.xi_bbn = NAN;
-    params.dneff_cmb = NAN;
-    params.dneff_bbn = NAN;
-    params.eta_si_per_mass = NAN;
-    params.del_si_per_mass = NAN;
-  }
+  finish_boltzmann(idid, integ.final, integ.y, params);
 }
 
 } // namespace darksun
@@ -3,11 +3,21 @@
 
 #include "darksun/model/parameters.hpp"
 #include "darksun/model/thermal_functions.hpp"
+#include <array>
 #include <boost/math/tools/roots.hpp>
 #include <gsl/gsl_sf_lambert.h>
+#include <gsl/gsl_spline.h>
+#include <utility>
+#include <vector>
 
 namespace darksun {
 
+// Binary digits to which Newton's method resolves xi, i.e. a relative
+// tolerance of about 1e-10
+static constexpr int XI_NEWTON_DIGITS = 34;
+// Maximum number of iterations of the root-finding for xi
+static constexpr boost::uintmax_t XI_MAX_ITERATIONS = 100;
+
 auto xi_bounds_const_td(const double td, const DarkSunParameters &params)
     -> std::pair<double, double> {
   const double hd = dark_heff(td, params);
@@ -50,20 +60,168 @@ double compute_xi_const_td(const double td, const DarkSunParameters &params) {
   auto f = [hd, td, c1](double xi) -> double {
     return hd * pow<3>(xi) - StandardModel::heff(td / xi) * c1;
   };
-  // Function specifying when to stop bisection algorithm
+  // Function specifying when to stop the root-finding
   auto tol = [](double min, double max) { return abs(max - min) <= 1e-8; };
 
-  // Perform bisection algorith to find xi.
+  // The SM degrees of freedom are interpolated data, so there is no analytic
+  // derivative. TOMS 748 needs far fewer evaluations than bisection.
   const auto bounds = xi_bounds_const_td(td, params);
-  const auto res = bisect(f, 0.8 * bounds.first, 1.2 * bounds.second, tol);
+  boost::uintmax_t max_iter = XI_MAX_ITERATIONS;
+  const auto res =
+      toms748_solve(f, 0.8 * bounds.first, 1.2 * bounds.second, tol, max_iter);
   // Return average of the bounding points
   return (res.second + res.first) / 2.0;
 }
 
-double compute_xi_const_tsm(const double tsm, const DarkSunParameters &params) {
+/**
+ * @brief Solve for xi at a fixed SM temperature assuming the dark sector is
+ * in thermal equilibrium with itself, i.e. before the eta freezes out.
+ *
+ * @param tsm Temperature of the standard model.
+ * @param params Parameters of the dark SU(N) model.
+ * @return Ratio of dark to SM temperatures.
+ *
+ * Entropy conservation, heff(xi tsm) xi^3 = const, is solved with Newton's
+ * method using the analytic derivative of heff, safeguarded by the bracket
+ * of `xi_bounds_const_tsm`. Successive calls are usually at nearby
+ * temperatures, so the iteration starts from the previous root, stored in
+ * `params.xi_hint`, and converges in about three steps.
+ */
+double solve_xi_const_tsm(const double tsm, const DarkSunParameters &params) {
   using namespace boost::math;
   using namespace boost::math::tools;
 
+  const double hsm = StandardModel::heff(tsm);
+  const double c1 = hsm * dark_heff_inf(params) * pow<3>(params.xi_inf) /
+                    StandardModel::HEFF_INF;
+
+  // In logarithmic form, the Boltzmann suppression of heff is close to
+  // linear, which keeps Newton's method in its quadratic regime
+  const double logc1 = log(c1);
+  auto f = [logc1, &params, tsm](double xi) -> std::pair<double, double> {
+    const auto lh = dark_log_heff(xi * tsm, params);
+    return std::make_pair(lh.first + 3.0 * log(xi) - logc1,
+                          (lh.second + 3.0) / xi);
+  };
+
+  const auto bounds = xi_bounds_const_tsm(tsm, params);
+  const double lb = 0.8 * bounds.first;
+  const double ub = 1.2 * bounds.second;
+  double guess = params.xi_hint;
+  if (!(lb < guess && guess < ub)) {
+    guess = 0.5 * (lb + ub);
+  }
+  boost::uintmax_t max_iter = XI_MAX_ITERATIONS;
+  const double xi =
+      newton_raphson_iterate(f, guess, lb, ub, XI_NEWTON_DIGITS, max_iter);
+  params.xi_hint = xi;
+  return xi;
+}
+
+/**
+ * @brief Return the parameters of the model which xi depends on. The table
+ * of `tabulate_xi_const_tsm` is only reused if these are unchanged.
+ */
+std::array<double, 5> xi_model_parameters(const DarkSunParameters &params) {
+  return {params.n, params.lam, params.mu_eta, params.mu_del, params.xi_inf};
+}
+
+/**
+ * @brief Build the table of xi vs. the SM temperature used by
+ * `compute_xi_const_tsm` before the eta freezes out.
+ *
+ * @param tsm_min Smallest SM temperature the table needs to cover.
+ * @param tsm_max Largest SM temperature the table needs to cover.
+ * @param params Parameters of the dark SU(N) model. The table is stored in
+ * `params.xi_spline`.
+ * @return True if the table was built, false if it failed the accuracy check.
+ *
+ * If `params.xi_spline` was already built for the same model and covers the
+ * range, it is kept. This happens when `Scanner` estimates a point with
+ * `estimate_boltzmann` before solving it.
+ *
+ * log(xi) is tabulated on a grid uniform in log(tsm) and interpolated using a
+ * monotone (Steffen) spline. After building the table, the interpolant is
+ * compared against `solve_xi_const_tsm` at the midpoints of a subset of the
+ * intervals. If the error is too large, the grid is refined. If refining
+ * doesn't help, the table is discarded and `compute_xi_const_tsm` falls back
+ * to the root-finding algorithm.
+ */
+bool tabulate_xi_const_tsm(const double tsm_min, const double tsm_max,
+                           DarkSunParameters &params) {
+  // Spacing in log(tsm) of the coarsest table. This is a bit smaller than the
+  // spacing of the SM data.
+  constexpr double dlogt = 0.02;
+  // Number of times we allow the grid to be refined
+  constexpr int max_refinements = 3;
+  // Every `check_stride` interval is compared to the exact result
+  constexpr size_t check_stride = 4;
+  // Tolerances used to check table
+  constexpr double rtol = 1e-6;
+  constexpr double atol = 1e-8;
+
+  // Pad the range by one step on either side
+  const double logt_min = log(tsm_min) - dlogt;
+  const double logt_max = log(tsm_max) + dlogt;
+
+  if (params.xi_spline != nullptr) {
+    if (params.xi_table_model == xi_model_parameters(params) &&
+        params.xi_log_tsm_min <= logt_min &&
+        logt_max <= params.xi_log_tsm_max) {
+      return true;
+    }
+    gsl_spline_free(params.xi_spline);
+    params.xi_spline = nullptr;
+  }
+  gsl_interp_accel_reset(params.acc_xi);
+
+  for (int r = 0; r <= max_refinements; r++) {
+    const double step = dlogt / double(1 << r);
+    const auto num = size_t(std::ceil((logt_max - logt_min) / step)) + 1;
+    const double dx = (logt_max - logt_min) / double(num - 1);
+
+    std::vector<double> logts(num);
+    std::vector<double> logxis(num);
+    for (size_t i = 0; i < num; i++) {
+      logts[i] = logt_min + double(i) * dx;
+      logxis[i] = log(solve_xi_const_tsm(exp(logts[i]), params));
+    }
+
+    gsl_spline *spline = gsl_spline_alloc(gsl_interp_steffen, num);
+    gsl_spline_init(spline, logts.data(), logxis.data(), num);
+
+    bool passed = true;
+    for (size_t i = 0; i < num - 1 && passed; i += check_stride) {
+      const double logt = logts[i] + 0.5 * dx;
+      const double xi = solve_xi_const_tsm(exp(logt), params);
+      const double xi_table = exp(gsl_spline_eval(spline, logt, params.acc_xi));
+      passed = std::abs(xi - xi_table) <= rtol * xi + atol;
+    }
+
+    if (passed) {
+      params.xi_spline = spline;
+      params.xi_log_tsm_min = logt_min;
+      params.xi_log_tsm_max = logt_max;
+      params.xi_table_model = xi_model_parameters(params);
+      return true;
+    }
+    gsl_spline_free(spline);
+  }
+  return false;
+}
+
+/**
+ * @brief Compute xi at a fixed SM temperature.
+ *
+ * @param tsm Temperature of the standard model.
+ * @param params Parameters of the dark SU(N) model.
+ * @return Ratio of dark to SM temperatures.
+ *
+ * After freeze-out, xi is determined by redshifting. Before freeze-out, xi is
+ * read off the table built by `tabulate_xi_const_tsm` if it exists and covers
+ * `tsm`. Otherwise, it is found using a root-finding algorithm.
+ */
+double compute_xi_const_tsm(const double tsm, const DarkSunParameters &params) {
   if (params.tsm_fo >= 0.0) {
     if (tsm < params.tsm_fo) {
       // If tsm_fo has a value, that means the eta has frozen out. In this case,
@@ -83,21 +241,13 @@ double compute_xi_const_tsm(const double tsm, const DarkSunParameters &params) {
 
   // The eta hasn't frozen out: assume that it is still in thermal
   // equillibrium with itself.
-  const double hsm = StandardModel::heff(tsm);
-  const double c1 = hsm * dark_heff_inf(params) * pow<3>(params.xi_inf) /
-                    StandardModel::HEFF_INF;
-
-  auto f = [c1, &params, tsm](double xi) -> double {
-    return dark_heff(xi * tsm, params) * pow<3>(xi) - c1;
-  };
-  // Function specifying when to stop bisection algorithm
-  auto tol = [](double min, double max) { return abs(max - min) <= 1e-8; };
-
-  // Perform bisection algorith to find xi.
-  const auto bounds = xi_bounds_const_tsm(tsm, params);
-  const auto res = bisect(f, 0.8 * bounds.first, 1.2 * bounds.second, tol);
-  // Return average of the bounding points
-  return (res.second + res.first) / 2.0;
+  if (params.xi_spline != nullptr) {
+    const double logt = log(tsm);
+    if (params.xi_log_tsm_min <= logt && logt <= params.xi_log_tsm_max) {
+      return exp(gsl_spline_eval(params.xi_spline, logt, params.acc_xi));
+    }
+  }
+  return solve_xi_const_tsm(tsm, params);
 }
 
 } // namespace darksun
@@ -1,9 +1,11 @@
 #ifndef DARKSUN_MODEL_CROSS_SECTIONS_HPP
 #define DARKSUN_MODEL_CROSS_SECTIONS_HPP
 
+#include "darksun/bessel.hpp"
 #include "darksun/model/parameters.hpp"
 #include "darksun/model/scaled_eta_cross_section.hpp"
-#include <boost/math/quadrature/gauss_kronrod.hpp>
+#include "darksun/quadrature.hpp"
+#include <array>
 #include <boost/math/special_functions/pow.hpp>
 #include <cmath>
 #include <gsl/gsl_sf_bessel.h>
@@ -15,19 +17,14 @@ namespace darksun {
 //===========================================================================
 
 /**
- *  @breif Compute the cross-section for 2eta->4eta at zero temperature.
+ *  @breif Compute the model dependent coefficients of the scaled 2eta->4eta
+ *  cross-sections.
  *
- *  @param  cme  Center-of-mass energy.
  *  @param  model  Pointer to an array of doubles containing model parameters.
- *  @return Cross-section.
- *
- *  To compute the cross-section for 2eta->4eta, we use the scaled
- *  cross-sections (see 'DarkSun::scaled_cs_eta_24_xx') and add the model
- *  dependent prefactors.
+ *  @return Coefficients of the A4*A4, A6*A6 and A4*A6 scaled cross-sections.
  */
-double cross_section_2eta_4eta(const double cme,
-                               const DarkSunParameters &params) {
-
+std::array<double, 3>
+cross_section_2eta_4eta_coefficients(const DarkSunParameters &params) {
   using namespace boost::math;
 
   // Common prefactors. Constant is (256 pi^4 / 3)^2
@@ -37,12 +34,29 @@ double cross_section_2eta_4eta(const double cme,
   const double c44 = com * pow<4>(params.lec1) / 9.0;
   const double c66 = com * pow<2>(params.lec2) / 25.0;
   const double c46 = -2.0 * com * pow<2>(params.lec1) * params.lec2 / 15.0;
+
+  return {c44, c66, c46};
+}
+
+/**
+ *  @breif Compute the cross-section for 2eta->4eta at zero temperature.
+ *
+ *  @param  cme  Center-of-mass energy.
+ *  @param  model  Pointer to an array of doubles containing model parameters.
+ *  @return Cross-section.
+ *
+ *  To compute the cross-section for 2eta->4eta, we use the scaled
+ *  cross-sections (see 'DarkSun::scaled_cs_eta_24_xx') and add the model
+ *  dependent prefactors.
+ */
+double cross_section_2eta_4eta(const double cme,
+                               const DarkSunParameters &params) {
+  const auto cs = cross_section_2eta_4eta_coefficients(params);
   // Scaled center-of-mass energy
   const double z = cme / m_eta(params);
 
-  return c44 * ScaledEtaCrossSection::scaled_cs_eta_44(z, params.acc_cs44) +
-         c66 * ScaledEtaCrossSection::scaled_cs_eta_66(z, params.acc_cs66) +
-         c46 * ScaledEtaCrossSection::scaled_cs_eta_46(z, params.acc_cs46);
+  const auto scaled = ScaledEtaCrossSection::scaled_cs_eta(z);
+  return cs[0] * scaled[0] + cs[1] * scaled[1] + cs[2] * scaled[2];
 }
 
 /**
@@ -76,27 +90,60 @@ double cross_section_2del_2del(const DarkSunParameters &params) {
   return 4.0 * pow<3>(M_PI) / pow<2>(params.lam);
 }
 
+/**
+ *  @breif Compute the cross-section for 2eta -> 2delta.
+ *
+ *  @param  model  Pointer to an array of doubles containing model parameters.
+ *  @return Cross-section.
+ *
+ *  The 2eta->2delta cross section is taken to be a constant, exponentially
+ *  suppressed in N with the suppression controlled by 'c'.
+ */
+double cross_section_2eta_2del(const DarkSunParameters &params) {
+  using namespace boost::math;
+  return exp(-2.0 * params.c * params.n) /
+         (64.0 * M_PI * pow<2>(params.n) * pow<2>(params.lam));
+}
+
 //===========================================================================
 //---- Thermally-averaged cross-sections ------------------------------------
 //===========================================================================
 
+// Quadrature nodes of the thermal integrals
+using ThermalNodes = BatchGaussKronrod15::Nodes;
+
+/**
+ * @brief Compute the kernel z^2 (z^2 - 4) e^(x z0) K1(x z) of the thermal
+ * integrals at the quadrature nodes `z`, with a single batched evaluation of
+ * the Bessel functions.
+ */
+void thermal_kernel(const double x, const double z0, const ThermalNodes &z,
+                    ThermalNodes &ker) {
+  ThermalNodes xz;
+  for (size_t i = 0; i < z.size(); i++) {
+    xz[i] = x * z[i];
+  }
+  bessel_k1_scaled(xz.data(), ker.data(), z.size());
+  for (size_t i = 0; i < z.size(); i++) {
+    const double z2 = z[i] * z[i];
+    ker[i] *= z2 * (z2 - 4.0) * exp(-x * (z[i] - z0));
+  }
+}
+
 double thermal_cross_section_2eta_4eta(const double x,
                                        const DarkSunParameters &params) {
-  using boost::math::quadrature::gauss_kronrod;
-
   const double den = 2.0 * gsl_sf_bessel_Kn_scaled(2, x);
   const double pre = x / (den * den);
   const double meta = m_eta(params);
 
-  auto f = [x, &params, meta](double z) -> double {
-    const double z2 = z * z;
-    const double sig = cross_section_2eta_4eta(z * meta, params);
-    const double ker =
-        z2 * (z2 - 4.0) * gsl_sf_bessel_K1_scaled(x * z) * exp(-x * (z - 2.0));
-    return sig * ker;
+  auto f = [x, &params, meta](const ThermalNodes &z, ThermalNodes &fz) {
+    thermal_kernel(x, 2.0, z, fz);
+    for (size_t i = 0; i < z.size(); i++) {
+      fz[i] *= cross_section_2eta_4eta(z[i] * meta, params);
+    }
   };
 
-  const double integral = gauss_kronrod<double, 15>::integrate(
+  const double integral = BatchGaussKronrod15::integrate(
       f, 4.0, std::numeric_limits<double>::infinity(), 5, 1e-8);
 
   return pre * integral;
@@ -105,76 +152,71 @@ double thermal_cross_section_2eta_4eta(const double x,
 double thermal_cross_section_4eta_2eta(const double x,
                                        const DarkSunParameters &params) {
   using boost::math::pow;
-  using boost::math::quadrature::gauss_kronrod;
 
   const double meta = m_eta(params);
   const double bes = gsl_sf_bessel_Kn_scaled(2, x);
   const double pre = pow<4>(M_PI) * pow<3>(x) / (pow<6>(meta) * pow<4>(bes));
 
-  auto f = [x, &params, meta](double z) -> double {
-    const double z2 = z * z;
-    const double sig = cross_section_2eta_4eta(z * meta, params);
-    const double ker =
-        z2 * (z2 - 4.0) * gsl_sf_bessel_K1_scaled(x * z) * exp(-x * (z - 4.0));
-    return sig * ker;
+  auto f = [x, &params, meta](const ThermalNodes &z, ThermalNodes &fz) {
+    thermal_kernel(x, 4.0, z, fz);
+    for (size_t i = 0; i < z.size(); i++) {
+      fz[i] *= cross_section_2eta_4eta(z[i] * meta, params);
+    }
   };
 
-  const double integral = gauss_kronrod<double, 15>::integrate(
+  const double integral = BatchGaussKronrod15::integrate(
       f, 4.0, std::numeric_limits<double>::infinity(), 5, 1e-8);
 
   return pre * integral;
 }
 
+/**
+ * @brief Compute the thermal integral of a constant cross-section,
+ *   e^(2x) int_zmin^inf dz z^2 (z^2 - 4) K1(xz),
+ * in closed form.
+ *
+ * With u = xz, u^2 K1(u) = -d/du[u^2 K2(u)] and u^3 K2(u) = -d/du[u^3 K3(u)],
+ * so that, integrating u^4 K1 by parts,
+ *   int_zmin^inf dz z^2 (z^2 - 4) K1(xz)
+ *     = zmin^2 / x [(zmin^2 - 4) K2(x zmin) + 2 zmin / x K3(x zmin)].
+ * The Bessel functions are scaled, leaving the Boltzmann suppression
+ * e^(-x (zmin - 2)) explicit.
+ */
+double thermal_integral_constant_cross_section(const double x,
+                                               const double zmin) {
+  const double u = x * zmin;
+  const auto k01 = bessel_k01_scaled(u);
+  const double k2 = k01.k0 + 2.0 / u * k01.k1;
+  const double k3 = k01.k1 + 4.0 / u * k2;
+  const double z2 = zmin * zmin;
+  return exp(-x * (zmin - 2.0)) * z2 / x *
+         ((z2 - 4.0) * k2 + 2.0 * zmin / x * k3);
+}
+
 double thermal_cross_section_2eta_2del(const double x,
                                        const DarkSunParameters &params) {
-  using boost::math::pow;
-  using boost::math::quadrature::gauss_kronrod;
-
   const double meta = m_eta(params);
   const double mdel = m_del(params);
 
   const double den = 2.0 * gsl_sf_bessel_Kn_scaled(2, x);
   const double pre = x / (den * den);
   const double zmin = 2.0 * mdel / meta;
-  const double sig = exp(-2.0 * params.c * params.n) /
-                     (64.0 * M_PI * pow<2>(params.n) * pow<2>(params.lam));
-
-  auto f = [x](double z) -> double {
-    const double z2 = z * z;
-    return z2 * (z2 - 4.0) * gsl_sf_bessel_K1_scaled(x * z) *
-           exp(-x * (z - 2.0));
-  };
-
-  const double integral = gauss_kronrod<double, 15>::integrate(
-      f, zmin, std::numeric_limits<double>::infinity(), 15, 1e-8);
+  const double sig = cross_section_2eta_2del(params);
 
-  return pre * sig * integral;
+  return pre * sig * thermal_integral_constant_cross_section(x, zmin);
 }
 
 double thermal_cross_section_2del_2eta(const double xeta,
                                        const DarkSunParameters &params) {
-  using boost::math::pow;
-  using boost::math::quadrature::gauss_kronrod;
-
   const double meta = m_eta(params);
   const double mdel = m_del(params);
   const double xdel = mdel * xeta / meta;
 
   const double den = 2.0 * gsl_sf_bessel_Kn_scaled(2, xdel);
   const double pre = xdel / (den * den);
-  const double sig = exp(-2.0 * params.c * params.n) /
-                     (64.0 * M_PI * pow<2>(params.n) * pow<2>(params.lam));
-
-  auto f = [xdel](double z) -> double {
-    const double z2 = z * z;
-    return z2 * (z2 - 4.0) * gsl_sf_bessel_K1_scaled(xdel * z) *
-           exp(-xdel * (z - 2.0));
-  };
-
-  const double integral = gauss_kronrod<double, 15>::integrate(
-      f, 2.0, std::numeric_limits<double>::infinity(), 15, 1e-8);
+  const double sig = cross_section_2eta_2del(params);
 
-  return pre * sig * integral;
+  return pre * sig * thermal_integral_constant_cross_section(xdel, 2.0);
 }
 
 } // namespace darksun
@@ -4,10 +4,35 @@
 #include <array>
 #include <cmath>
 #include <cstdlib>
+#include <functional>
 #include <gsl/gsl_spline.h>
+#include <stiff/common.hpp>
+#include <stiff/events.hpp>
+#include <vector>
 
 namespace darksun {
 
+/**
+ * Thermodynamic quantities entering the Boltzmann equation at a given
+ * log(x). These depend only on log(x) and not on the abundances.
+ */
+struct BoltzmannState {
+  double logx = NAN; // log(meta / tsm). NAN marks an empty cache entry.
+  double tsm;        // SM temperature
+  double xi;         // Ratio of dark to SM temperatures
+  double we_eq;      // log of the equilibrium eta abundance
+  double fe;         // Prefactor of the 4eta->2eta term: -s^2 <sv>_42 ...
+  double fd;         // Prefactor of the 2eta->2del term: <sv>_ed ...
+};
+
+// Integrators available for the Boltzmann equations. See `solve_boltzmann`.
+enum class BoltzmannSolver { Radau5, Rodas };
+
+// Sampling of the solution of the Boltzmann equations: nothing, the initial
+// and final states, a user-supplied grid of log(x), or every accepted step
+// streamed to a callback. See `solout`.
+enum class SolutionOutput { None, Endpoints, Grid, Callback };
+
 class DarkSunParameters {
 
 public:
@@ -32,31 +57,71 @@ public:
   double eta_si_per_mass = -1.0;
   double del_si_per_mass = -1.0;
 
-  // These are used for controlling how the ODE solution is generated
-  static constexpr size_t SOL_LENGTH = 100;
-  double dlogx = -1.0; // Spacing between logx for solution output
-  double logx = -1.0;  // Current value logx
-  size_t sol_idx = 0;  // Index where solution should be inserted
-  std::array<double, SOL_LENGTH> ts{};
-  std::array<std::array<double, 2>, SOL_LENGTH> ys{};
+  // Integrator used for the Boltzmann equations
+  BoltzmannSolver solver = BoltzmannSolver::Radau5;
+  // If true, the integration is handed over to the explicit DOPRI5 once the
+  // eta' has frozen out and the system is no longer stiff
+  bool stiffness_switching = false;
+  // Work done by the solver of the Boltzmann equations. The time spent in
+  // each phase of the solver is only measured if `time_solver` is true.
+  bool time_solver = false;
+  stiff::SolverStats solver_stats{};
+  // Wall-clock time in seconds spent computing the derived quantities. Set
+  // by `Scanner`.
+  double solve_time = 0.0;
+  // True if `Scanner` skipped the integration of the Boltzmann equations and
+  // the derived quantities are those of `estimate_boltzmann`
+  bool skipped = false;
+
+  // Sampling of the solution of the Boltzmann equations. See `solout`.
+  SolutionOutput output = SolutionOutput::None;
+  // Increasing log(x) at which the solution is sampled with
+  // `SolutionOutput::Grid`. Points outside the integration range are skipped.
+  std::vector<double> output_logx{};
+  // Called with log(x) and (log(Y_eta), Y_del) at the start of the
+  // integration and after every accepted step with `SolutionOutput::Callback`
+  std::function<void(double, const std::array<double, 2> &)>
+      output_callback{};
+  // Sampled log(x) and (log(Y_eta), Y_del) for `SolutionOutput::Endpoints`
+  // and `SolutionOutput::Grid`
+  std::vector<double> ts{};
+  std::vector<std::array<double, 2>> ys{};
+  size_t output_idx = 0; // Next point of `output_logx` to sample
+  // Freeze-out of the eta', located on the dense output of the solver
+  stiff::Event freeze_out;
+
+  // Cache of the thermodynamic state at the most recent values of log(x).
+  // RADAU evaluates the RHS and Jacobian repeatedly at the same stage times,
+  // so the cache has room for the largest number of stages plus one.
+  static constexpr size_t STATE_CACHE_SIZE = 8;
+  mutable std::array<BoltzmannState, STATE_CACHE_SIZE> state_cache{};
+  mutable size_t state_cache_idx = 0;
 
-  // Accelerators for use in interpolation function
-  gsl_interp_accel *acc_cs44;
-  gsl_interp_accel *acc_cs66;
-  gsl_interp_accel *acc_cs46;
+  // Most recent root of `solve_xi_const_tsm`, used as its starting point
+  mutable double xi_hint = -1.0;
+  // Table of log(xi) vs. log(tsm) valid before the eta freezes out. Built by
+  // `tabulate_xi_const_tsm` and used by `compute_xi_const_tsm` when available.
+  gsl_spline *xi_spline = nullptr;
+  gsl_interp_accel *acc_xi;
+  double xi_log_tsm_min = 0.0;
+  double xi_log_tsm_max = 0.0;
+  // Parameters of the model the table was built for. See
+  // `xi_model_parameters`.
+  std::array<double, 5> xi_table_model{};
 
   DarkSunParameters(double n, double lam) : n(n), lam(lam) {
-    acc_cs44 = gsl_interp_accel_alloc();
-    acc_cs66 = gsl_interp_accel_alloc();
-    acc_cs46 = gsl_interp_accel_alloc();
+    acc_xi = gsl_interp_accel_alloc();
   }
   ~DarkSunParameters() {
-    gsl_interp_accel_free(acc_cs44);
-    gsl_interp_accel_free(acc_cs66);
-    gsl_interp_accel_free(acc_cs46);
+    gsl_interp_accel_free(acc_xi);
+    if (xi_spline != nullptr) {
+      gsl_spline_free(xi_spline);
+    }
   }
 
-private:
+  // The parameters own the GSL objects above and cannot be copied
+  DarkSunParameters(const DarkSunParameters &) = delete;
+  DarkSunParameters &operator=(const DarkSunParameters &) = delete;
 };
 
 double m_eta(const DarkSunParameters &params) {
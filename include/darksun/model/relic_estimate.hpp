@@ -0,0 +1,97 @@
+#ifndef DARKSUN_MODEL_RELIC_ESTIMATE_HPP
+#define DARKSUN_MODEL_RELIC_ESTIMATE_HPP
+
+#include "darksun/model/boltzmann.hpp"
+#include "darksun/model/parameters.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stiff/stiff.hpp>
+
+namespace darksun {
+
+//===========================================================================
+//---- Sudden freeze-out estimate of the relic densities --------------------
+//===========================================================================
+
+// Spacing in log(x) of the quadrature used by `estimate_boltzmann`
+static constexpr double ESTIMATE_DLOGX = 0.05;
+
+/**
+ * @brief Estimate the derived quantities of `params` without integrating the
+ * Boltzmann equations, using the sudden freeze-out approximation for the
+ * eta'.
+ *
+ * The eta' tracks its equilibrium abundance until the rate 2|fe| Yeq^3 at
+ * which the 4eta->2eta processes restore equilibrium drops below the rate
+ * |dWeq/dlog(x)| at which the equilibrium abundance changes. The inverse
+ * processes are neglected afterwards, so dY/dlog(x) = fe Y^4 integrates to
+ * Y^-3 = Y_fo^-3 + 3 int |fe| dlog(x). The del abundance is the integral of
+ * fd Y^2. Both integrals use the trapezoidal rule on the thermodynamic states
+ * of `boltzmann_state`, which costs a small fraction of an integration.
+ *
+ * The results are recorded as by `solve_boltzmann`, with the freeze-out at
+ * the point where the approximation switches over. The solver statistics are
+ * zero.
+ */
+void estimate_boltzmann(DarkSunParameters &params) {
+  double start;
+  double final;
+  BoltzmannVector y;
+  setup_boltzmann(params, start, final, y);
+  params.solver_stats = stiff::SolverStats{};
+
+  const auto num =
+      size_t(std::max(1.0, std::ceil((final - start) / ESTIMATE_DLOGX)));
+  const double dlogx = (final - start) / double(num);
+
+  // Equilibrium until the eta' freezes out. The states are copied since the
+  // cache only holds the most recent ones.
+  BoltzmannState prev = boltzmann_state(start, params);
+  double ydel = 0.0;
+  size_t i = 1;
+  for (; i <= num; i++) {
+    const BoltzmannState state =
+        boltzmann_state(start + double(i) * dlogx, params);
+    ydel += 0.5 * dlogx *
+            (prev.fd * exp(2.0 * prev.we_eq) +
+             state.fd * exp(2.0 * state.we_eq));
+    const double rate = 2.0 * std::abs(state.fe) * exp(3.0 * state.we_eq);
+    const double dweq = std::abs(state.we_eq - prev.we_eq) / dlogx;
+    prev = state;
+    if (rate < dweq) {
+      break;
+    }
+  }
+  y[0] = prev.we_eq;
+
+  if (i <= num) {
+    params.xi_fo = prev.xi;
+    params.tsm_fo = prev.tsm;
+    clear_boltzmann_state(params);
+
+    // log(Y_fo^-3) and 3 int |fe| dlog(x) since freeze-out
+    const double lfo = -3.0 * y[0];
+    double integral = 0.0;
+    for (i++; i <= num; i++) {
+      const BoltzmannState state =
+          boltzmann_state(start + double(i) * dlogx, params);
+      integral += 1.5 * dlogx * (std::abs(prev.fe) + std::abs(state.fe));
+      // log(Y^-3) = log(Y_fo^-3 + integral), without overflow
+      const double lint = log(integral);
+      const double lsum = std::max(lfo, lint) +
+                          std::log1p(exp(-std::abs(lfo - lint)));
+      const double we = -lsum / 3.0;
+      ydel += 0.5 * dlogx *
+              (prev.fd * exp(2.0 * y[0]) + state.fd * exp(2.0 * we));
+      y[0] = we;
+      prev = state;
+    }
+  }
+  y[1] = ydel;
+
+  finish_boltzmann(1, final, y, params);
+}
+
+} // namespace darksun
+
+#endif // DARKSUN_MODEL_RELIC_ESTIMATE_HPP
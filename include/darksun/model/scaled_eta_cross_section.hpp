@@ -1,13 +1,49 @@
 #ifndef DARKSUN_MODEL_SCALED_ETA_CROSS_SECTION_HPP
 #define DARKSUN_MODEL_SCALED_ETA_CROSS_SECTION_HPP
 
+#include "darksun/interpolation.hpp"
+#include <algorithm>
+#include <array>
+#include <boost/math/special_functions/pow.hpp>
 #include <cmath>
-#include <gsl/gsl_spline.h>
 
 namespace darksun {
 
 class ScaledEtaCrossSection {
 public:
+  /**
+   *  @breif Compute the scaled cross-sections for 2eta->4eta from the 4pt
+   *  interactions, the 6pt interactions and their interference in one pass.
+   *
+   *  @param  z  Center-of-mass energy divided by eta mass: z = cme/meta.
+   *  @return Scaled cross-sections {44, 66, 46}.
+   *
+   *  See `scaled_cs_eta_44`, `scaled_cs_eta_66` and `scaled_cs_eta_46`. The
+   *  three channels share the data grid, so log10(z) and the interpolation
+   *  interval are computed only once. This is the version to use in
+   *  integrands. Just above threshold, the data is replaced by its
+   *  (z - 4)^(7/2) behavior (see `threshold_cs`).
+   */
+  static std::array<double, 3> scaled_cs_eta(double z) {
+    const auto &inst = get_instance();
+    if (4.0 < z && z < inst.threshold_zs.back()) {
+      return {inst.threshold_cs(z, 0), inst.threshold_cs(z, 1),
+              inst.threshold_cs(z, 2)};
+    }
+    const double logz = log10(z);
+    if (log_eta_z_min <= logz && logz <= log_eta_z_max) {
+      const auto vals = inst.splines(logz);
+      return {exp(M_LN10 * vals[0]), exp(M_LN10 * vals[1]),
+              exp(M_LN10 * vals[2])};
+    } else if (logz >= log_eta_z_max) {
+      const auto &norms = inst.high_z_norms;
+      const double z14 = boost::math::pow<14>(z);
+      return {z14 * norms[0], z14 * norms[1], z14 * norms[2]};
+    } else {
+      return {0.0, 0.0, 0.0};
+    }
+  }
+
   /**
    *  @breif Compute the scaled cross-section for 2eta->4eta using only 4pt
    *  interactions
@@ -23,17 +59,7 @@ public:
    *  energies beyond the interpolation range, we use a fit of the fo erm
    *  log10(cs) = m * log10(z) + b with m = 14 and b='eta_cs_intercept44'.
    */
-  static double scaled_cs_eta_44(double z, gsl_interp_accel *acc) {
-    const double logz = log10(z);
-    if (log_eta_z_min <= logz && logz <= log_eta_z_max) {
-      double val = gsl_spline_eval(get_instance().spline_cs44, logz, acc);
-      return pow(10.0, val);
-    } else if (logz >= log_eta_z_max) {
-      return pow(z, 14) * pow(10.0, eta_cs_intercept44);
-    } else {
-      return 0.0;
-    }
-  }
+  static double scaled_cs_eta_44(double z) { return scaled_cs_eta(z, 0); }
 
   /**
    *  @breif Compute the scaled cross-section for 2eta->4eta using only 6pt
@@ -50,17 +76,7 @@ public:
    *  energies beyond the interpolation range, we use a fit of the form
    *  log10(cs) = m * log10(z) + b with m = 14 and b='eta_cs_intercept66'.
    */
-  static double scaled_cs_eta_66(double z, gsl_interp_accel *acc) {
-    const double logz = log10(z);
-    if (log_eta_z_min <= logz && logz <= log_eta_z_max) {
-      double val = gsl_spline_eval(get_instance().spline_cs66, logz, acc);
-      return std::pow(10.0, val);
-    } else if (logz >= log_eta_z_max) {
-      return pow(z, 14) * pow(10.0, eta_cs_intercept66);
-    } else {
-      return 0.0;
-    }
-  }
+  static double scaled_cs_eta_66(double z) { return scaled_cs_eta(z, 1); }
 
   /**
    *  @breif Compute the scaled cross-section for 2eta->4eta using only the
@@ -79,16 +95,36 @@ public:
    * A6. For energies beyond the interpolation range, we use a fit of the form
    *  log10(cs) = m * log10(z) + b with m = 14 and b='eta_cs_intercept46'.
    */
-  static double scaled_cs_eta_46(double z, gsl_interp_accel *acc) {
-    const double logz = log10(z);
-    if (log_eta_z_min <= logz && logz <= log_eta_z_max) {
-      double val = gsl_spline_eval(get_instance().spline_cs46, logz, acc);
-      return std::pow(10.0, val);
-    } else if (logz >= log_eta_z_max) {
-      return pow(z, 14) * pow(10.0, eta_cs_intercept46);
-    } else {
-      return 0.0;
+  static double scaled_cs_eta_46(double z) { return scaled_cs_eta(z, 2); }
+
+  /**
+   * @brief Return the limits of the scaled cross-sections divided by
+   * (z - 4)^(7/2) as z -> 4 for the 44, 66 and 46 channels.
+   */
+  static std::array<double, 3> threshold_coefficients() {
+    const auto &inst = get_instance();
+    const auto &zs = inst.threshold_zs;
+    const double t = (4.0 - zs[0]) / (zs[1] - zs[0]);
+    std::array<double, 3> coeffs{};
+    for (size_t j = 0; j < 3; j++) {
+      const auto &cs = inst.threshold_coeffs[j];
+      coeffs[j] = cs[0] + t * (cs[1] - cs[0]);
     }
+    return coeffs;
+  }
+
+  // Number of data points interpolated by the splines
+  static constexpr size_t NUM_DATA = 500;
+  // Number of data points near threshold interpolated by `threshold_cs`
+  static constexpr size_t NUM_THRESHOLD_DATA = 16;
+
+  /**
+   * @brief Return the data interpolated by the splines: log10(z) followed by
+   * log10 of the scaled cross-sections for the 44, 66 and 46 channels, each
+   * holding `NUM_DATA` points.
+   */
+  static std::array<const double *, 4> data() {
+    return {log_eta_zs, log_eta_cs44, log_eta_cs66, log_eta_cs46};
   }
 
 private:
@@ -100,24 +136,72 @@ private:
    */
   static ScaledEtaCrossSection &get_instance() { return instance; }
 
-  gsl_spline *spline_cs44;
-  gsl_spline *spline_cs66;
-  gsl_spline *spline_cs46;
+  /// Compute only channel `j` of `scaled_cs_eta`.
+  static double scaled_cs_eta(double z, size_t j) {
+    const auto &inst = get_instance();
+    if (4.0 < z && z < inst.threshold_zs.back()) {
+      return inst.threshold_cs(z, j);
+    }
+    const double logz = log10(z);
+    if (log_eta_z_min <= logz && logz <= log_eta_z_max) {
+      return exp(M_LN10 * inst.splines(logz, j));
+    } else if (logz >= log_eta_z_max) {
+      return boost::math::pow<14>(z) * inst.high_z_norms[j];
+    } else {
+      return 0.0;
+    }
+  }
+
+  /**
+   * Near threshold, the four-body phase space makes the cross-section vanish
+   * as (z - 4)^(7/2). The data jumps by twelve orders of magnitude between
+   * z - 4 = 1e-5 and the next point at z - 4 = 0.026, and the spline in
+   * log10(z) rings over the first intervals. Up to the data point
+   * `NUM_THRESHOLD_DATA - 1`, the cross-section is instead (z - 4)^(7/2)
+   * times a coefficient interpolated linearly between the data points.
+   */
+  double threshold_cs(double z, size_t j) const {
+    const double k = std::max(0.0, (log10(z) - log_eta_z_min) / log_eta_z_step);
+    const size_t i = std::min(size_t(k), NUM_THRESHOLD_DATA - 2);
+    const double t =
+        (z - threshold_zs[i]) / (threshold_zs[i + 1] - threshold_zs[i]);
+    const auto &coeffs = threshold_coeffs[j];
+    const double coeff = coeffs[i] + t * (coeffs[i + 1] - coeffs[i]);
+    const double dz = z - 4.0;
+    return coeff * dz * dz * dz * sqrt(dz);
+  }
 
-  ScaledEtaCrossSection() {
-    spline_cs44 = gsl_spline_alloc(gsl_interp_cspline, 500);
-    spline_cs66 = gsl_spline_alloc(gsl_interp_cspline, 500);
-    spline_cs46 = gsl_spline_alloc(gsl_interp_cspline, 500);
+  // Splines of log10(cs) vs. log10(z) for the 44, 66 and 46 channels
+  UniformCubicSplineArray<3> splines;
+  // 10^intercept for the large-z fits of the 44, 66 and 46 channels
+  std::array<double, 3> high_z_norms;
+  // Data points near threshold and cs / (z - 4)^(7/2) at each for every
+  // channel
+  std::array<double, NUM_THRESHOLD_DATA> threshold_zs;
+  std::array<std::array<double, NUM_THRESHOLD_DATA>, 3> threshold_coeffs;
 
-    gsl_spline_init(spline_cs44, log_eta_zs, log_eta_cs44, 500);
-    gsl_spline_init(spline_cs66, log_eta_zs, log_eta_cs66, 500);
-    gsl_spline_init(spline_cs46, log_eta_zs, log_eta_cs46, 500);
+  ScaledEtaCrossSection()
+      : splines(log_eta_z_min, log_eta_z_step,
+                {log_eta_cs44, log_eta_cs66, log_eta_cs46}, NUM_DATA),
+        high_z_norms({pow(10.0, eta_cs_intercept44),
+                      pow(10.0, eta_cs_intercept66),
+                      pow(10.0, eta_cs_intercept46)}) {
+    const std::array<const double *, 3> log_css = {log_eta_cs44, log_eta_cs66,
+                                                   log_eta_cs46};
+    for (size_t i = 0; i < NUM_THRESHOLD_DATA; i++) {
+      threshold_zs[i] = pow(10.0, log_eta_zs[i]);
+      const double dz = threshold_zs[i] - 4.0;
+      for (size_t j = 0; j < 3; j++) {
+        threshold_coeffs[j][i] =
+            pow(10.0, log_css[j][i]) / (dz * dz * dz * sqrt(dz));
+      }
+    }
   }
 
-  static const double log_eta_zs[500];
-  static const double log_eta_cs44[500];
-  static const double log_eta_cs66[500];
-  static const double log_eta_cs46[500];
+  static const double log_eta_zs[NUM_DATA];
+  static const double log_eta_cs44[NUM_DATA];
+  static const double log_eta_cs66[NUM_DATA];
+  static const double log_eta_cs46[NUM_DATA];
 
   // Data was fit from log10(4+10^-5) to log10(100) with 500 steps
   static constexpr double log_eta_z_min = 0.60206107706280998056;
@@ -128,18 +212,11 @@ private:
   static constexpr double eta_cs_intercept44 = -11.116318726988425;
   static constexpr double eta_cs_intercept66 = -12.038358477167012;
   static constexpr double eta_cs_intercept46 = -11.57800399152332;
-
-public:
-  ~ScaledEtaCrossSection() {
-    gsl_spline_free(spline_cs44);
-    gsl_spline_free(spline_cs66);
-    gsl_spline_free(spline_cs46);
-  }
 };
 
 ScaledEtaCrossSection ScaledEtaCrossSection::instance = ScaledEtaCrossSection();
 
-const double ScaledEtaCrossSection::log_eta_zs[500] = {
+const double ScaledEtaCrossSection::log_eta_zs[NUM_DATA] = {
     0.60206107706280998, 0.6048625578702993,
     0.60766403867778873, 0.61046551948527805,
     0.61326700029276737, 0.6160684811002568,
@@ -391,7 +468,7 @@ const double ScaledEtaCrossSection::log_eta_zs[500] = {
     1.9915955575775319,  1.9943970383850216,
     1.9971985191925108,  2};
 
-const double ScaledEtaCrossSection::log_eta_cs44[500] = {
+const double ScaledEtaCrossSection::log_eta_cs44[NUM_DATA] = {
     -21.619915941437206,  -9.6422517617184464,   -8.5521382675721362,
     -7.8990336946499404,  -7.4259882020140564,   -7.0506789327842059,
     -6.7376065300594821,  -6.466696173059451,    -6.2286232297383259,
@@ -560,7 +637,7 @@ const double ScaledEtaCrossSection::log_eta_cs44[500] = {
     16.727252905292541,   16.766573622286121,    16.805902132451365,
     16.845325820895535,   16.885120365499329};
 
-const double ScaledEtaCrossSection::log_eta_cs66[500] = {
+const double ScaledEtaCrossSection::log_eta_cs66[NUM_DATA] = {
     -22.610699838455872,   -10.632811295686771,  -9.5427249268328911,
     -8.8895499200861394,   -8.4152509670015636,  -8.0400115206308449,
     -7.7258821829235504,   -7.4554707512391349,  -7.2161873873113551,
@@ -729,7 +806,7 @@ const double ScaledEtaCrossSection::log_eta_cs66[500] = {
     15.805272304652613,    15.845078067854528,   15.884344407608117,
     15.923079182954867,    15.962706240770885};
 
-const double ScaledEtaCrossSection::log_eta_cs46[500] = {
+const double ScaledEtaCrossSection::log_eta_cs46[NUM_DATA] = {
     -22.115225920468887,  -10.137750631552878,   -9.0477531674590619,
     -8.3943695431090468,  -7.9204339970856337,   -7.545349850794552,
     -7.2322724133124279,  -6.9612611943076264,   -6.7218914215245382,
@@ -0,0 +1,242 @@
+#ifndef DARKSUN_MODEL_THERMAL_CROSS_SECTION_TABLE_HPP
+#define DARKSUN_MODEL_THERMAL_CROSS_SECTION_TABLE_HPP
+
+#include "darksun/bessel.hpp"
+#include "darksun/interpolation.hpp"
+#include "darksun/model/cross_sections.hpp"
+#include "darksun/model/parameters.hpp"
+#include "darksun/model/scaled_eta_cross_section.hpp"
+#include "darksun/quadrature.hpp"
+#include <algorithm>
+#include <array>
+#include <boost/math/special_functions/pow.hpp>
+#include <cmath>
+#include <gsl/gsl_sf_bessel.h>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace darksun {
+
+//===========================================================================
+//---- Interpolation table in x = m / T -------------------------------------
+//===========================================================================
+
+/**
+ * @brief Table of a positive function of x = m / T, interpolated in
+ * log(f) vs. log10(x) using a cubic spline on a uniform grid.
+ *
+ * The table is immutable once constructed, so a single table can be shared
+ * between threads.
+ */
+class ThermalCrossSectionTable {
+public:
+  /**
+   * @brief Tabulate `f` on a grid uniform in log10(x).
+   *
+   * @param f Function to tabulate. Must be positive on the grid.
+   * @param log_x_min Lower bound of log10(x).
+   * @param log_x_max Upper bound of log10(x).
+   * @param num Number of grid points.
+   */
+  template <class F>
+  ThermalCrossSectionTable(F f, double log_x_min, double log_x_max, size_t num)
+      : spline(log_x_min, (log_x_max - log_x_min) / double(num - 1),
+               tabulate(f, log_x_min, log_x_max, num).data(), num) {}
+
+  /// Returns true if `x` is within the range of the table.
+  bool contains(double x) const {
+    const double logx = log10(x);
+    return spline.x_min() <= logx && logx <= spline.x_max();
+  }
+
+  /// Returns log(f(x)). Only valid if `contains(x)` is true.
+  double log_eval(double x) const { return spline(log10(x)); }
+
+  /// Returns f(x). Only valid if `contains(x)` is true.
+  double operator()(double x) const { return exp(log_eval(x)); }
+
+  /// Returns the largest x in the table.
+  double x_max() const { return pow(10.0, spline.x_max()); }
+
+  /// Returns f at the largest x in the table.
+  double back() const { return exp(spline(spline.x_max())); }
+
+private:
+  UniformCubicSpline spline;
+
+  template <class F>
+  static std::vector<double> tabulate(F f, double log_x_min, double log_x_max,
+                                      size_t num) {
+    const double step = (log_x_max - log_x_min) / double(num - 1);
+    std::vector<double> logfs(num);
+    for (size_t i = 0; i < num; i++) {
+      logfs[i] = log(f(pow(10.0, log_x_min + double(i) * step)));
+    }
+    return logfs;
+  }
+};
+
+//===========================================================================
+//---- Lazily-built tables of thermally-averaged cross-sections -------------
+//===========================================================================
+
+/**
+ * @brief Cache of the tables used to compute the thermally-averaged
+ * cross-sections appearing in the Boltzmann equation.
+ *
+ * For 4eta->2eta, the model-dependent prefactors of the 2eta->4eta
+ * cross-section can be pulled out of the thermal integral, leaving three
+ * integrals over the scaled cross-sections (44, 66 and 46) which depend only
+ * on x. These are tabulated once per process.
+ *
+ * The 2eta->2del cross-section is a constant, so its thermal integral is
+ * known in closed form and needs no table. See
+ * `thermal_integral_constant_cross_section`.
+ */
+class ThermalCrossSectionCache {
+public:
+  using Table = ThermalCrossSectionTable;
+  using TablePtr = std::shared_ptr<const Table>;
+
+  // Ranges of log10(x) covered by the tables. Beyond, see
+  // `threshold_4eta_2eta`.
+  static constexpr double LOG_X_MIN_4ETA_2ETA = -2.0;
+  static constexpr double LOG_X_MAX_4ETA_2ETA = 5.0;
+  static constexpr size_t NUM_X_4ETA_2ETA = 701;
+
+  /**
+   * @brief Return the tables of x^3 / K2(x)^4 * J(x) for the 44, 66 and 46
+   * scaled cross-sections, where
+   *   J(x) = e^(4x) int_4^inf dz z^2 (z^2 - 4) K1(xz) sig(z).
+   */
+  static const std::array<TablePtr, 3> &tables_4eta_2eta() {
+    static const std::array<TablePtr, 3> tables = build_tables_4eta_2eta();
+    return tables;
+  }
+
+  /**
+   * @brief Return the tabulated functions for x beyond the tables.
+   *
+   * At large x, only z - 4 of order 1/x contributes, where the scaled
+   * cross-sections are A (z - 4)^(7/2) (see
+   * `ScaledEtaCrossSection::threshold_coefficients`). Expanding the Bessel
+   * functions, the tabulated functions approach
+   *   f_inf = 4 / pi^2 * 192 * sqrt(pi / 8) * Gamma(9 / 2) * A
+   *         = 1260 sqrt(2) / pi * A,
+   * up to corrections of order 1/x. These are matched to the end of the
+   * tables, so that the error is of order 1/x^2 and the tables reach all the
+   * way to the CMB.
+   */
+  static std::array<double, 3> threshold_4eta_2eta(double x) {
+    const auto &tables = tables_4eta_2eta();
+    const auto coeffs = ScaledEtaCrossSection::threshold_coefficients();
+    const double x_max = tables[0]->x_max();
+    std::array<double, 3> fs{};
+    for (size_t i = 0; i < 3; i++) {
+      const double f_inf = 1260.0 * M_SQRT2 / M_PI * coeffs[i];
+      fs[i] = f_inf + (tables[i]->back() - f_inf) * x_max / x;
+    }
+    return fs;
+  }
+
+private:
+  /**
+   * Compute e^(x z0) int_z0^inf dz z^2 (z^2 - 4) K1(xz) sig(z). The
+   * integral is performed in u = x (z - z0) so that the exponential always
+   * falls off on a scale of order one. The range is split at z = `zsplit`
+   * to avoid integrating over a kink in `sig`. At large x, u = x (zsplit -
+   * z0) is huge, so [0, usplit] is split further into panels growing by a
+   * factor of 4 from u = 1, so that the first panels resolve the peak.
+   */
+  template <class F>
+  static double thermal_integral(F sig, double x, double z0, double zsplit) {
+    using Quad = BatchGaussKronrod15;
+    auto f = [sig, x, z0](const Quad::Nodes &u, Quad::Nodes &fu) {
+      Quad::Nodes z;
+      Quad::Nodes xz;
+      for (size_t i = 0; i < u.size(); i++) {
+        z[i] = z0 + u[i] / x;
+        xz[i] = x * z[i];
+      }
+      bessel_k1_scaled(xz.data(), fu.data(), u.size());
+      for (size_t i = 0; i < u.size(); i++) {
+        const double z2 = z[i] * z[i];
+        fu[i] *= sig(z[i]) * z2 * (z2 - 4.0) * exp(-u[i]);
+      }
+    };
+    const double inf = std::numeric_limits<double>::infinity();
+    if (zsplit <= z0) {
+      return Quad::integrate(f, 0.0, inf, 15, 1e-10) / x;
+    }
+    const double usplit = x * (zsplit - z0);
+    double integral = Quad::integrate(f, usplit, inf, 15, 1e-10);
+    double ulo = 0.0;
+    for (double uhi = 1.0; ulo < usplit; uhi *= 4.0) {
+      const double umax = std::min(uhi, usplit);
+      integral += Quad::integrate(f, ulo, umax, 15, 1e-10);
+      ulo = umax;
+    }
+    return integral / x;
+  }
+
+  static std::array<TablePtr, 3> build_tables_4eta_2eta() {
+    using ScaledFn = double (*)(double);
+    const std::array<ScaledFn, 3> scaled = {
+        ScaledEtaCrossSection::scaled_cs_eta_44,
+        ScaledEtaCrossSection::scaled_cs_eta_66,
+        ScaledEtaCrossSection::scaled_cs_eta_46};
+    // Scaled cross-section data ends at z = 100, where it switches to a fit.
+    constexpr double zsplit = 100.0;
+
+    std::array<TablePtr, 3> tables;
+    for (size_t i = 0; i < 3; i++) {
+      auto sig = scaled[i];
+      auto f = [sig](double x) -> double {
+        using boost::math::pow;
+        const double bes = gsl_sf_bessel_Kn_scaled(2, x);
+        return pow<3>(x) / pow<4>(bes) * thermal_integral(sig, x, 4.0, zsplit);
+      };
+      tables[i] = std::make_shared<const Table>(f, LOG_X_MIN_4ETA_2ETA,
+                                                LOG_X_MAX_4ETA_2ETA,
+                                                NUM_X_4ETA_2ETA);
+    }
+    return tables;
+  }
+};
+
+//===========================================================================
+//---- Tabulated thermally-averaged cross-sections --------------------------
+//===========================================================================
+
+/**
+ * @brief Compute the thermally-averaged cross-section for 4eta->2eta using
+ * the cached tables.
+ *
+ * @param x Eta mass divided by the dark temperature.
+ * @param params Parameters of the dark SU(N) model.
+ *
+ * Beyond the tables, uses the threshold expansion of
+ * `ThermalCrossSectionCache::threshold_4eta_2eta`. Falls back to
+ * `thermal_cross_section_4eta_2eta` below the range of the tables.
+ */
+double tabulated_thermal_cross_section_4eta_2eta(
+    const double x, const DarkSunParameters &params) {
+  using boost::math::pow;
+  const auto &tables = ThermalCrossSectionCache::tables_4eta_2eta();
+  std::array<double, 3> fs{};
+  if (tables[0]->contains(x)) {
+    fs = {(*tables[0])(x), (*tables[1])(x), (*tables[2])(x)};
+  } else if (x > tables[0]->x_max()) {
+    fs = ThermalCrossSectionCache::threshold_4eta_2eta(x);
+  } else {
+    return thermal_cross_section_4eta_2eta(x, params);
+  }
+  const auto cs = cross_section_2eta_4eta_coefficients(params);
+  const double pre = pow<4>(M_PI) / pow<6>(m_eta(params));
+  return pre * (cs[0] * fs[0] + cs[1] * fs[1] + cs[2] * fs[2]);
+}
+
+} // namespace darksun
+
+#endif // DARKSUN_MODEL_THERMAL_CROSS_SECTION_TABLE_HPP
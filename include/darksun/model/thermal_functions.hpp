@@ -3,11 +3,78 @@
 
 #include "darksun/model/parameters.hpp"
 #include "darksun/standard_model.hpp"
+#include <algorithm>
 #include <boost/math/special_functions/pow.hpp>
 #include <gsl/gsl_sf_bessel.h>
+#include <utility>
 
 namespace darksun {
 
+//===========================================================================
+//---- Bessel-function sums -------------------------------------------------
+//===========================================================================
+
+// Number of terms kept in the expansion of the Bose-Einstein distribution of
+// the eta
+static constexpr int ETA_THERMAL_TERMS = 5;
+
+/**
+ * @brief Sums over the first terms of the expansion of a thermal
+ * distribution, in terms of the modified Bessel functions K_n((1+k)x), with
+ * x = m / T. All sums are multiplied by e^x, so they remain finite for large
+ * x.
+ */
+struct ThermalSums {
+  // e^x sum_k K2((1+k)x) / (1+k): number density and entropy
+  double k2 = 0.0;
+  // e^x sum_k K3((1+k)x) / (1+k): entropy degrees of freedom
+  double k3 = 0.0;
+  // e^x sum_k [(1+k)x K1((1+k)x) + 3 K2((1+k)x)] / (1+k)^2: energy degrees
+  // of freedom
+  double g = 0.0;
+  // e^x sum_k K2((1+k)x): d/dx[x^3 e^-x k3] = -x^3 e^-x dk3
+  double dk3 = 0.0;
+};
+
+/**
+ * @brief Compute the thermal sums of `ThermalSums` over `terms` terms.
+ *
+ * K0 and K1 are evaluated once per argument and K2 and K3 are obtained by
+ * upward recurrence, K_{n+1}(z) = K_{n-1}(z) + 2n/z K_n(z), which is stable
+ * for the K_n. The factors e^{-kx} relating the scaled Bessel functions of
+ * the different terms are powers of a single exponential.
+ */
+ThermalSums thermal_sums(const double x, const int terms) {
+  ThermalSums sums;
+  const double r = exp(-x);
+  double rk = 1.0; // e^{-kx}
+  for (int k = 0; k < terms; k++) {
+    const double j = 1.0 + k;
+    const double z = j * x;
+    const double k0 = gsl_sf_bessel_K0_scaled(z);
+    const double k1 = gsl_sf_bessel_K1_scaled(z);
+    const double k2 = k0 + 2.0 / z * k1;
+    const double k3 = k1 + 4.0 / z * k2;
+    sums.k2 += rk * k2 / j;
+    sums.k3 += rk * k3 / j;
+    sums.g += rk * (z * k1 + 3.0 * k2) / (j * j);
+    sums.dk3 += rk * k2;
+    rk *= r;
+  }
+  return sums;
+}
+
+/**
+ * @brief Thermodynamic quantities of the dark sector at a dark temperature
+ * `td = xi * tsm`, computed together from a single evaluation of the thermal
+ * sums of the eta and the del. See `dark_thermodynamics`.
+ */
+struct DarkThermodynamics {
+  double heff;    // Entropy degrees of freedom, see `dark_heff`
+  double geff;    // Energy degrees of freedom, see `dark_geff`
+  double weq_eta; // log of the equilibrium eta abundance, see `weq_eta`
+};
+
 //===========================================================================
 //---- Functions for computing equilibrium number densities -----------------
 //===========================================================================
@@ -19,11 +86,7 @@ double neq_eta(const double td, const DarkSunParameters &params) {
   const double g = 1.0;
   const double fac = g * pow<2>(x) * pow<3>(td) / (2.0 * pow<2>(M_PI));
 
-  double bessum = 0.0;
-  for (int k = 0; k < 5; k++) {
-    bessum += gsl_sf_bessel_Kn(2, (1 + k) * x) / (1 + k);
-  }
-  return fac * bessum;
+  return fac * exp(-x) * thermal_sums(x, ETA_THERMAL_TERMS).k2;
 }
 
 double neq_del(const double td, const DarkSunParameters &params) {
@@ -51,11 +114,7 @@ double yeq_eta(const double tsm, const double xi,
   const double fac = 45.0 * g * pow<2>(x) * pow<3>(xi) /
                      (4.0 * pow<4>(M_PI) * StandardModel::heff(tsm));
 
-  double bessum = 0.0;
-  for (int k = 0; k < 5; k++) {
-    bessum += gsl_sf_bessel_Kn(2, (1 + k) * x) / (1 + k);
-  }
-  return fac * bessum;
+  return fac * exp(-x) * thermal_sums(x, ETA_THERMAL_TERMS).k2;
 }
 
 double yeq_del(const double tsm, const double xi,
@@ -83,11 +142,7 @@ double weq_eta(const double tsm, const double xi,
   const double fac = 45.0 * g * pow<2>(x) * pow<3>(xi) /
                      (4.0 * pow<4>(M_PI) * StandardModel::heff(tsm));
 
-  double bessum = 0.0;
-  for (int k = 0; k < 5; k++) {
-    bessum += exp(-k * x) * gsl_sf_bessel_Kn_scaled(2, (1 + k) * x) / (1 + k);
-  }
-  return -x + log(fac * bessum);
+  return -x + log(fac * thermal_sums(x, ETA_THERMAL_TERMS).k2);
 }
 
 double weq_del(const double tsm, const double xi,
@@ -116,61 +171,107 @@ double dark_heff_inf(const DarkSunParameters &params) {
   return 7.0 / 2.0 * params.n + 2.0 * (params.n * params.n - 1.0);
 }
 
-double dark_heff(const double td, const DarkSunParameters &params) {
+/**
+ * @brief Compute the entropy and energy degrees of freedom of the dark sector
+ * and the equilibrium abundance of the eta, evaluating the Bessel functions of
+ * the eta and the del once for all of them.
+ *
+ * @param tsm Temperature of the standard model.
+ * @param xi Ratio of dark to SM temperatures.
+ * @param params Parameters of the dark SU(N) model.
+ */
+DarkThermodynamics dark_thermodynamics(const double tsm, const double xi,
+                                       const DarkSunParameters &params) {
   using boost::math::pow;
+  const double td = xi * tsm;
   const double xe = m_eta(params) / td;
   const double xd = m_del(params) / td;
 
   const double ge = 1.0;
   const double gd = g_del(params);
 
-  const double etae = 1.0;
-  // const double etad = params.n % 2 == 0 ? 1.0 : -1.0;
+  // The del is kept at leading order in the expansion of its distribution
+  const auto sume = thermal_sums(xe, ETA_THERMAL_TERMS);
+  const auto sumd = thermal_sums(xd, 1);
+  const double ee = exp(-xe);
+  const double ed = exp(-xd);
+
+  DarkThermodynamics thermo;
+
+  const double preh = 45.0 / (4.0 * pow<4>(M_PI));
+  thermo.heff = preh * ge * pow<3>(xe) * ee * sume.k3 +
+                preh * gd * pow<3>(xd) * ed * sumd.k3;
+
+  const double preg = 30.0 / (2.0 * pow<4>(M_PI));
+  thermo.geff = preg * ge * pow<2>(xe) * ee * sume.g +
+                preg * gd * pow<2>(xd) * ed * sumd.g;
+
+  const double fac = 45.0 * ge * pow<2>(xe) * pow<3>(xi) /
+                     (4.0 * pow<4>(M_PI) * StandardModel::heff(tsm));
+  thermo.weq_eta = -xe + log(fac * sume.k2);
+
+  return thermo;
+}
+
+double dark_heff(const double td, const DarkSunParameters &params) {
+  using boost::math::pow;
+  const double xe = m_eta(params) / td;
+  const double xd = m_del(params) / td;
 
   const double pre = 45.0 / (4.0 * pow<4>(M_PI));
-  const double pree = pre * ge * pow<3>(xe);
-  const double pred = pre * gd * pow<3>(xd);
-
-  double bessume = 0.0;
-  double bessumd = 0.0;
-  for (int k = 0; k < 5; k++) {
-    bessume += std::pow(etae, k) / (1 + k) * gsl_sf_bessel_Kn(3, (1 + k) * xe);
-    // bessumd += std::pow(etad, k) / (1 + k) * gsl_sf_bessel_Kn(3, (1 + k) *
-    // xd);
-  }
-  bessumd = gsl_sf_bessel_Kn(3, xd);
+  const double pree = pre * pow<3>(xe) * exp(-xe);
+  const double pred = pre * g_del(params) * pow<3>(xd) * exp(-xd);
 
-  return pree * bessume + pred * bessumd;
+  return pree * thermal_sums(xe, ETA_THERMAL_TERMS).k3 +
+         pred * thermal_sums(xd, 1).k3;
 }
 
-double dark_geff(const double td, const DarkSunParameters &params) {
+/**
+ * @brief Compute the logarithm of the entropy degrees of freedom of the dark
+ * sector, see `dark_heff`, and its derivative with respect to log(td).
+ *
+ * The derivative follows from d/du[u^3 K3(u)] = -u^3 K2(u) and uses the same
+ * Bessel functions as heff itself. The Boltzmann factors are combined in
+ * log-space, so the result stays finite when heff itself underflows.
+ *
+ * @return {log(heff), d(log heff)/d(log td)}
+ */
+std::pair<double, double> dark_log_heff(const double td,
+                                        const DarkSunParameters &params) {
   using boost::math::pow;
   const double xe = m_eta(params) / td;
   const double xd = m_del(params) / td;
 
-  const double ge = 1.0;
-  const double gd = g_del(params);
+  const auto sume = thermal_sums(xe, ETA_THERMAL_TERMS);
+  const auto sumd = thermal_sums(xd, 1);
+  const double le = 3.0 * log(xe) - xe + log(sume.k3);
+  const double ld = log(g_del(params)) + 3.0 * log(xd) - xd + log(sumd.k3);
+
+  // Weights of the eta and del relative to the larger of the two
+  const double lmax = std::max(le, ld);
+  const double we = exp(le - lmax);
+  const double wd = exp(ld - lmax);
+
+  const double pre = 45.0 / (4.0 * pow<4>(M_PI));
+  const double logh = log(pre) + lmax + log(we + wd);
+  // d/d(log td) = -x d/dx
+  const double dlogh = (we * xe * sume.dk3 / sume.k3 +
+                        wd * xd * sumd.dk3 / sumd.k3) /
+                       (we + wd);
+  return std::make_pair(logh, dlogh);
+}
 
-  const double etae = 1.0;
-  // const double etad = params.n % 2 == 0 ? 1.0 : -1.0;
+double dark_geff(const double td, const DarkSunParameters &params) {
+  using boost::math::pow;
+  const double xe = m_eta(params) / td;
+  const double xd = m_del(params) / td;
 
   const double pre = 30.0 / (2.0 * pow<4>(M_PI));
-  const double pree = pre * ge * pow<2>(xe);
-  const double pred = pre * gd * pow<2>(xd);
-
-  double bessume = 0.0;
-  double bessumd = 0.0;
-  for (int k = 0; k < 5; k++) {
-    bessume += std::pow(etae, k) / pow<2>(1 + k) *
-               ((1 + k) * xe * gsl_sf_bessel_Kn(1, (1 + k) * xe) +
-                3.0 * gsl_sf_bessel_Kn(2, (1 + k) * xe));
-    //    bessumd += std::pow(etad, k) / pow<2>(1 + k) *
-    //               ((1 + k) * xd * gsl_sf_bessel_Kn(1, (1 + k) * xd) +
-    //                3.0 * gsl_sf_bessel_Kn(2, (1 + k) * xd));
-  }
-  bessumd += xd * gsl_sf_bessel_Kn(1, xd) + 3.0 * gsl_sf_bessel_Kn(2, xd);
+  const double pree = pre * pow<2>(xe) * exp(-xe);
+  const double pred = pre * g_del(params) * pow<2>(xd) * exp(-xd);
 
-  return pree * bessume + pred * bessumd;
+  return pree * thermal_sums(xe, ETA_THERMAL_TERMS).g +
+         pred * thermal_sums(xd, 1).g;
 }
 
 double sqrt_gstar(const double tsm, const double xi,
@@ -181,6 +282,15 @@ double sqrt_gstar(const double tsm, const double xi,
   return StandardModel::sqrt_gstar(tsm) * sqrt(gsm / (gsm + gd * pow<4>(xi)));
 }
 
+/// sqrt(g_*) given the thermodynamics of the dark sector at xi * tsm.
+double sqrt_gstar(const double tsm, const double xi,
+                  const DarkThermodynamics &thermo) {
+  using boost::math::pow;
+  const double gsm = StandardModel::geff(tsm);
+  return StandardModel::sqrt_gstar(tsm) *
+         sqrt(gsm / (gsm + thermo.geff * pow<4>(xi)));
+}
+
 } // namespace darksun
 
 #endif // DARKSUN_MODEL_THERMAL_FUNCTIONS_HPP
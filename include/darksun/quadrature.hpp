@@ -0,0 +1,147 @@
+#ifndef DARKSUN_QUADRATURE_HPP
+#define DARKSUN_QUADRATURE_HPP
+
+#include <algorithm>
+#include <array>
+#include <boost/math/quadrature/gauss.hpp>
+#include <boost/math/quadrature/gauss_kronrod.hpp>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace darksun {
+
+//===========================================================================
+//---- Gauss-Kronrod quadrature with batched integrands ---------------------
+//===========================================================================
+
+/**
+ * @brief Adaptive 15-point Gauss-Kronrod quadrature evaluating the integrand
+ * on all nodes of an interval in a single call.
+ *
+ * The integrand is called as `f(const Nodes &x, Nodes &fx)` and must fill
+ * `fx[i] = f(x[i])`. This lets it evaluate expensive special functions, such
+ * as `bessel_k1_scaled`, for the whole batch at once.
+ *
+ * The nodes and weights are those of boost's `gauss_kronrod<double, 15>`, as
+ * are the mapping of infinite upper limits and the refinement strategy, so
+ * `integrate` is a drop-in replacement for
+ * `gauss_kronrod<double, 15>::integrate(f, a, b, max_depth, tol)`.
+ */
+class BatchGaussKronrod15 {
+public:
+  static constexpr size_t NUM_NODES = 15;
+  using Nodes = std::array<double, NUM_NODES>;
+
+  /**
+   * @brief Integrate `f` over [a, b], where b may be infinite.
+   *
+   * @param max_depth Maximum number of bisections of an interval.
+   * @param tol Relative tolerance on the estimated error.
+   */
+  template <class F>
+  static double integrate(F f, double a, double b, unsigned max_depth,
+                          double tol) {
+    if (a == b) {
+      return 0.0;
+    }
+    if (std::isinf(b)) {
+      // x = a + 2 / (t + 1) - 1 maps t in (-1, 1] to [a, inf)
+      auto u = [&f, a](const Nodes &t, Nodes &ft) {
+        Nodes x;
+        Nodes jac;
+        for (size_t i = 0; i < NUM_NODES; i++) {
+          const double z = 1.0 / (t[i] + 1.0);
+          x[i] = 2.0 * z + a - 1.0;
+          jac[i] = z * z;
+        }
+        f(static_cast<const Nodes &>(x), ft);
+        for (size_t i = 0; i < NUM_NODES; i++) {
+          ft[i] *= jac[i];
+        }
+      };
+      return 2.0 * adaptive(u, -1.0, 1.0, max_depth, 0.0, tol);
+    }
+    if (b < a) {
+      return -adaptive(f, b, a, max_depth, 0.0, tol);
+    }
+    return adaptive(f, a, b, max_depth, 0.0, tol);
+  }
+
+private:
+  // Nodes on [-1, 1] and the Kronrod and Gauss weights. The node 0 is first,
+  // followed by the pairs +x, -x.
+  struct Rule {
+    Nodes x{};
+    Nodes wk{};
+    Nodes wg{};
+  };
+
+  static const Rule &rule() {
+    static const Rule rule = build_rule();
+    return rule;
+  }
+
+  static Rule build_rule() {
+    using boost::math::quadrature::gauss;
+    using boost::math::quadrature::gauss_kronrod;
+    const auto &abscissa = gauss_kronrod<double, NUM_NODES>::abscissa();
+    const auto &kronrod = gauss_kronrod<double, NUM_NODES>::weights();
+    const auto &gaussw = gauss<double, NUM_NODES / 2>::weights();
+    Rule r;
+    r.x[0] = abscissa[0];
+    r.wk[0] = kronrod[0];
+    r.wg[0] = gaussw[0];
+    for (size_t i = 1; i < abscissa.size(); i++) {
+      // The Gauss nodes are every second Kronrod node
+      const double wg = i % 2 == 0 ? gaussw[i / 2] : 0.0;
+      for (size_t j : {2 * i - 1, 2 * i}) {
+        r.x[j] = j % 2 == 1 ? abscissa[i] : -abscissa[i];
+        r.wk[j] = kronrod[i];
+        r.wg[j] = wg;
+      }
+    }
+    return r;
+  }
+
+  template <class F>
+  static double adaptive(F &f, double a, double b, unsigned max_depth,
+                         double abs_tol, double tol) {
+    const auto &r = rule();
+    const double mean = 0.5 * (b + a);
+    const double scale = 0.5 * (b - a);
+
+    Nodes x;
+    Nodes fx;
+    for (size_t i = 0; i < NUM_NODES; i++) {
+      x[i] = scale * r.x[i] + mean;
+    }
+    f(static_cast<const Nodes &>(x), fx);
+
+    double kronrod = 0.0;
+    double gauss = 0.0;
+    for (size_t i = 0; i < NUM_NODES; i++) {
+      kronrod += r.wk[i] * fx[i];
+      gauss += r.wg[i] * fx[i];
+    }
+    constexpr double eps = std::numeric_limits<double>::epsilon();
+    const double error =
+        std::max(std::abs(kronrod - gauss), 2.0 * eps * std::abs(kronrod));
+    const double estimate = scale * kronrod;
+
+    const double abs_tol1 = std::abs(estimate * tol);
+    if (abs_tol == 0.0) {
+      abs_tol = abs_tol1;
+    }
+    if (max_depth > 0 && abs_tol1 < error && abs_tol < error) {
+      const double mid = 0.5 * (a + b);
+      return adaptive(f, a, mid, max_depth - 1, 0.5 * abs_tol, tol) +
+             adaptive(f, mid, b, max_depth - 1, 0.5 * abs_tol, tol);
+    }
+    return estimate;
+  }
+};
+
+} // namespace darksun
+
+#endif // DARKSUN_QUADRATURE_HPP
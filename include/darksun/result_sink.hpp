@@ -0,0 +1,519 @@
+#ifndef DARKSUN_RESULT_SINK_HPP
+#define DARKSUN_RESULT_SINK_HPP
+
+#include "darksun/model/parameters.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace darksun {
+
+//===========================================================================
+//---- Schema of scan results -----------------------------------------------
+//===========================================================================
+
+static constexpr size_t NUM_RESULT_COLUMNS = 32;
+
+// Names of the columns written for each point of a scan. The columns after
+// DEL_SI_PER_MASS record the work done by the Boltzmann solver (see
+// `stiff::SolverStats`) and the time spent on the point. SKIPPED is 1 if the
+// derived quantities are estimates from `Scanner::prescreen`, else 0.
+static constexpr std::array<const char *, NUM_RESULT_COLUMNS> RESULT_COLUMNS =
+    {"N",         "LAM",       "C",
+     "ADEL",      "LEC1",      "LEC2",
+     "MU_ETA",    "MU_DEL",    "XI_INF",
+     "XI_FO",     "TSM_FO",    "XI_CMB",
+     "XI_BBN",    "RD_ETA",    "RD_DEL",
+     "DNEFF_CMB", "DNEFF_BBN", "ETA_SI_PER_MASS",
+     "DEL_SI_PER_MASS",
+     "NFCN",      "NJAC",      "NSTEP",
+     "NACCPT",    "NREJCT",    "NDEC",
+     "NSOL",      "TIME_FCN",  "TIME_JAC",
+     "TIME_DEC",  "TIME_SOL",  "SOLVE_TIME",
+     "SKIPPED"};
+
+/// Return the column names separated by commas.
+std::string result_header() {
+  std::string header;
+  for (size_t i = 0; i < NUM_RESULT_COLUMNS; i++) {
+    header += (i == 0 ? "" : ",");
+    header += RESULT_COLUMNS[i];
+  }
+  return header;
+}
+
+/// Return the values of the columns in `RESULT_COLUMNS` for `params`.
+std::array<double, NUM_RESULT_COLUMNS>
+result_row(const DarkSunParameters &params) {
+  return {params.n,         params.lam,       params.c,
+          params.adel,      params.lec1,      params.lec2,
+          params.mu_eta,    params.mu_del,    params.xi_inf,
+          params.xi_fo,     params.tsm_fo,    params.xi_cmb,
+          params.xi_bbn,    params.rd_eta,    params.rd_del,
+          params.dneff_cmb, params.dneff_bbn, params.eta_si_per_mass,
+          params.del_si_per_mass,
+          double(params.solver_stats.nfcn),
+          double(params.solver_stats.njac),
+          double(params.solver_stats.nstep),
+          double(params.solver_stats.naccpt),
+          double(params.solver_stats.nrejct),
+          double(params.solver_stats.ndec),
+          double(params.solver_stats.nsol),
+          params.solver_stats.time_fcn,
+          params.solver_stats.time_jac,
+          params.solver_stats.time_dec,
+          params.solver_stats.time_sol,
+          params.solve_time,
+          double(params.skipped)};
+}
+
+/**
+ * @brief Destination of the results of a scan.
+ *
+ * `write` is called concurrently by the workers of a scan, each passing its
+ * own worker index, and `close` is called once all workers have finished.
+ */
+class ResultSink {
+public:
+  virtual ~ResultSink() = default;
+
+  /**
+   * @brief Record the results for grid point `idx`. Must only be called from
+   * the thread owning `worker`.
+   */
+  virtual void write(size_t worker, size_t idx,
+                     const DarkSunParameters &params) = 0;
+
+  /// Finish writing and close the file.
+  virtual void close() = 0;
+};
+
+//===========================================================================
+//---- Buffered CSV output of scan results ----------------------------------
+//===========================================================================
+
+/**
+ * @brief Writes the results of a scan to a CSV file.
+ *
+ * Each worker formats its rows into its own buffer without taking any locks.
+ * Once a buffer holds `BLOCK_SIZE` bytes, it is handed off to a single writer
+ * thread, so the only synchronization is one short critical section per
+ * block. Unless a journal is kept, nothing is flushed until the sink is
+ * closed. With a journal, a buffer is also handed off once it holds
+ * `JOURNAL_ROWS` rows or its first row is `JOURNAL_INTERVAL` old, which
+ * bounds the work lost when the scan is killed.
+ *
+ * If `ordered` is true, the writer holds rows back until all rows with a
+ * smaller grid index have been written, so the file is sorted by index.
+ * Otherwise rows are written in the order in which blocks arrive.
+ *
+ * If a journal file is given, the sink appends to the output file instead of
+ * truncating it, and after each batch of rows is flushed to disk it appends a
+ * line to the journal holding the size of the output file followed by the
+ * grid indices of the rows in the batch. See `recover_scan_journal`.
+ */
+class CsvResultSink final : public ResultSink {
+public:
+  // Size of the worker buffers before they are handed to the writer
+  static constexpr size_t BLOCK_SIZE = 1 << 16;
+  // Limits on the rows held by a worker buffer when a journal is kept
+  static constexpr size_t JOURNAL_ROWS = 64;
+  static constexpr std::chrono::seconds JOURNAL_INTERVAL{10};
+
+  /**
+   * @param file_name Name of the output file.
+   * @param num_workers Number of workers writing to the sink.
+   * @param ordered If true, write the rows sorted by grid index.
+   * @param journal_name Name of the journal file. If empty, no journal is
+   * kept and the output file is truncated.
+   * @param completed Sorted grid indices already present in the output file
+   * when resuming a scan.
+   */
+  CsvResultSink(const std::string &file_name, size_t num_workers,
+                bool ordered = false, const std::string &journal_name = "",
+                std::vector<size_t> completed = {})
+      : ordered(ordered), journaled(!journal_name.empty()),
+        buffers(num_workers),
+        completed(std::move(completed)) {
+    if (journal_name.empty()) {
+      ofile.open(file_name);
+    } else {
+      ofile.open(file_name, std::ios::app);
+      journal.open(journal_name, std::ios::app);
+      if (!journal.is_open()) {
+        throw std::runtime_error("Cannot open file: " + journal_name);
+      }
+    }
+    if (!ofile.is_open()) {
+      throw std::runtime_error("Cannot open file: " + file_name);
+    }
+    file_size = std::filesystem::file_size(file_name);
+    if (file_size == 0) {
+      const std::string header = result_header() + '\n';
+      ofile << header;
+      file_size += header.size();
+    }
+    skip_completed();
+    writer = std::thread([this] { this->write_blocks(); });
+  }
+  ~CsvResultSink() override { close(); }
+
+  CsvResultSink(const CsvResultSink &) = delete;
+  CsvResultSink &operator=(const CsvResultSink &) = delete;
+
+  void write(size_t worker, size_t idx,
+             const DarkSunParameters &params) override {
+    auto &block = buffers[worker];
+    if (journaled && block.rows.empty()) {
+      block.opened = std::chrono::steady_clock::now();
+    }
+    block.rows.emplace_back(idx, block.text.size());
+    format_row(block.text, params);
+    if (block.text.size() >= BLOCK_SIZE || (journaled && journal_due(block))) {
+      submit(std::move(block));
+      block = Block{};
+    }
+  }
+
+  /**
+   * @brief Hand off the remaining buffers, wait for the writer to finish and
+   * close the file. Must not be called while workers are writing.
+   */
+  void close() override {
+    if (!writer.joinable()) {
+      return;
+    }
+    for (auto &block : buffers) {
+      if (!block.rows.empty()) {
+        submit(std::move(block));
+        block = Block{};
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+    }
+    cv.notify_one();
+    writer.join();
+    // Rows missing from an ordered scan leave gaps; write whatever is left
+    std::vector<size_t> idxs;
+    for (const auto &row : pending) {
+      ofile << row.second;
+      file_size += row.second.size();
+      idxs.push_back(row.first);
+    }
+    pending.clear();
+    record(idxs);
+    ofile.close();
+    journal.close();
+  }
+
+  /// Append the CSV row for `params` (including the newline) to `out`.
+  static void format_row(std::string &out, const DarkSunParameters &params) {
+    fmt::format_to(std::back_inserter(out), "{}\n",
+                   fmt::join(result_row(params), ","));
+  }
+
+private:
+  // Formatted rows together with their grid indices and offsets into `text`,
+  // and the time the first row was added when a journal is kept
+  struct Block {
+    std::vector<std::pair<size_t, size_t>> rows;
+    std::string text;
+    std::chrono::steady_clock::time_point opened;
+  };
+
+  bool ordered;
+  bool journaled;
+  std::vector<Block> buffers;
+  std::ofstream ofile;
+
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Block> queue;
+  bool done = false;
+
+  // Rows waiting for earlier indices when writing in order
+  std::map<size_t, std::string> pending;
+  size_t next_idx = 0;
+
+  // Journal of completed rows, the size of the output file and the indices
+  // that were completed before the sink was created
+  std::ofstream journal;
+  uint64_t file_size = 0;
+  std::vector<size_t> completed;
+
+  // Whether a block should be journaled before it reaches `BLOCK_SIZE`
+  static bool journal_due(const Block &block) {
+    return block.rows.size() >= JOURNAL_ROWS ||
+           std::chrono::steady_clock::now() - block.opened >= JOURNAL_INTERVAL;
+  }
+
+  // Advance `next_idx` past the rows written by an earlier scan
+  void skip_completed() {
+    while (std::binary_search(completed.begin(), completed.end(), next_idx)) {
+      next_idx++;
+    }
+  }
+
+  // Flush the output and record the indices of the rows just written
+  void record(const std::vector<size_t> &idxs) {
+    if (!journal.is_open() || idxs.empty()) {
+      return;
+    }
+    ofile.flush();
+    std::string line = std::to_string(file_size);
+    for (auto idx : idxs) {
+      line += ' ';
+      line += std::to_string(idx);
+    }
+    journal << line << '\n';
+    journal.flush();
+  }
+
+  void submit(Block &&block) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(std::move(block));
+    }
+    cv.notify_one();
+  }
+
+  void write_blocks() {
+    while (true) {
+      Block block;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return done || !queue.empty(); });
+        if (queue.empty()) {
+          return;
+        }
+        block = std::move(queue.front());
+        queue.pop_front();
+      }
+      if (ordered) {
+        write_ordered(block);
+      } else {
+        ofile.write(block.text.data(), std::streamsize(block.text.size()));
+        file_size += block.text.size();
+        std::vector<size_t> idxs(block.rows.size());
+        for (size_t i = 0; i < block.rows.size(); i++) {
+          idxs[i] = block.rows[i].first;
+        }
+        record(idxs);
+      }
+    }
+  }
+
+  void write_ordered(const Block &block) {
+    for (size_t i = 0; i < block.rows.size(); i++) {
+      const size_t begin = block.rows[i].second;
+      const size_t end = i + 1 < block.rows.size() ? block.rows[i + 1].second
+                                                   : block.text.size();
+      pending.emplace(block.rows[i].first,
+                      block.text.substr(begin, end - begin));
+    }
+    std::vector<size_t> idxs;
+    auto it = pending.begin();
+    while (it != pending.end() && it->first == next_idx) {
+      ofile << it->second;
+      file_size += it->second.size();
+      idxs.push_back(it->first);
+      it = pending.erase(it);
+      next_idx++;
+      skip_completed();
+    }
+    record(idxs);
+  }
+};
+
+/**
+ * @brief Recover the state of an interrupted CSV scan from its journal.
+ *
+ * @param file_name Name of the output file of the scan.
+ * @param journal_name Name of the journal written by `CsvResultSink`.
+ * @return Sorted grid indices whose rows are in the output file.
+ *
+ * The output file and the journal are truncated to the last complete journal
+ * entry, which discards any rows written after it. If there is no journal,
+ * the scan starts afresh, provided the output file is absent or empty.
+ *
+ * @throws std::runtime_error If the journal is missing but the output file
+ * is not empty, in which case neither file is touched, or if the journal
+ * refers to more data than the output file holds.
+ */
+std::vector<size_t> recover_scan_journal(const std::string &file_name,
+                                         const std::string &journal_name) {
+  namespace fs = std::filesystem;
+  std::vector<size_t> completed;
+  uint64_t file_size = 0;
+  uint64_t journal_size = 0;
+  if (!fs::exists(journal_name) && fs::exists(file_name) &&
+      fs::file_size(file_name) > 0) {
+    throw std::runtime_error("Cannot resume " + file_name + ": journal " +
+                             journal_name + " is missing");
+  }
+  if (fs::exists(journal_name) && fs::exists(file_name)) {
+    std::ifstream ifile(journal_name);
+    std::string line;
+    uint64_t pos = 0;
+    while (std::getline(ifile, line)) {
+      pos += line.size() + 1;
+      // An incomplete last line means the scan was killed while writing it
+      if (ifile.eof()) {
+        break;
+      }
+      std::istringstream ss(line);
+      uint64_t size;
+      ss >> size;
+      size_t idx;
+      while (ss >> idx) {
+        completed.push_back(idx);
+      }
+      file_size = size;
+      journal_size = pos;
+    }
+    if (file_size > fs::file_size(file_name)) {
+      throw std::runtime_error("Journal " + journal_name +
+                               " does not match file " + file_name);
+    }
+  }
+  for (const auto &name : {file_name, journal_name}) {
+    if (!fs::exists(name)) {
+      std::ofstream create(name);
+    }
+  }
+  fs::resize_file(file_name, file_size);
+  fs::resize_file(journal_name, journal_size);
+  std::sort(completed.begin(), completed.end());
+  return completed;
+}
+
+//===========================================================================
+//---- Binary columnar output of scan results -------------------------------
+//===========================================================================
+
+/**
+ * @brief Writes the results of a scan to a binary file with one contiguous
+ * column of doubles per entry of `RESULT_COLUMNS`.
+ *
+ * The file consists of
+ *   - the 8 magic bytes "DSNCOL01",
+ *   - the number of columns, the number of rows and the byte offset of the
+ *     data, each as a little-endian uint64,
+ *   - the comma-separated column names, zero-padded up to the data offset
+ *     (a multiple of 64 bytes),
+ *   - the columns, one after the other, as little-endian doubles.
+ * Row i holds grid point i, so the file is always ordered by grid index.
+ * Rows for grid points that were never written are NaN. The data can be
+ * memory-mapped directly, e.g. with `read_scan_columns` in
+ * analysis/scripts/utils.py.
+ *
+ * Each worker collects its rows without taking any locks and the file is
+ * written in one go when the sink is closed.
+ */
+class BinaryResultSink final : public ResultSink {
+public:
+  static constexpr char MAGIC[8] = {'D', 'S', 'N', 'C', 'O', 'L', '0', '1'};
+
+  /**
+   * @param file_name Name of the output file.
+   * @param num_workers Number of workers writing to the sink.
+   * @param num_rows Number of grid points in the scan, if known. The file has
+   * at least this many rows.
+   */
+  BinaryResultSink(const std::string &file_name, size_t num_workers,
+                   size_t num_rows = 0)
+      : num_rows(num_rows), rows(num_workers) {
+    ofile.open(file_name, std::ios::binary);
+    if (!ofile.is_open()) {
+      throw std::runtime_error("Cannot open file: " + file_name);
+    }
+  }
+  ~BinaryResultSink() override { close(); }
+
+  BinaryResultSink(const BinaryResultSink &) = delete;
+  BinaryResultSink &operator=(const BinaryResultSink &) = delete;
+
+  void write(size_t worker, size_t idx,
+             const DarkSunParameters &params) override {
+    rows[worker].emplace_back(idx, result_row(params));
+  }
+
+  void close() override {
+    if (!ofile.is_open()) {
+      return;
+    }
+    size_t nrows = num_rows;
+    for (const auto &wrows : rows) {
+      for (const auto &row : wrows) {
+        nrows = std::max(nrows, row.first + 1);
+      }
+    }
+    std::vector<double> columns(NUM_RESULT_COLUMNS * nrows, NAN);
+    for (const auto &wrows : rows) {
+      for (const auto &row : wrows) {
+        for (size_t j = 0; j < NUM_RESULT_COLUMNS; j++) {
+          columns[j * nrows + row.first] = row.second[j];
+        }
+      }
+    }
+    rows.clear();
+
+    const std::string names = result_header();
+    const uint64_t offset = (32 + names.size() + 63) / 64 * 64;
+    std::string header(offset, '\0');
+    std::memcpy(&header[0], MAGIC, sizeof(MAGIC));
+    put_uint64(&header[8], NUM_RESULT_COLUMNS);
+    put_uint64(&header[16], nrows);
+    put_uint64(&header[24], offset);
+    std::memcpy(&header[32], names.data(), names.size());
+    ofile.write(header.data(), std::streamsize(header.size()));
+
+    static_assert(sizeof(double) == 8, "doubles must be 64-bit");
+    std::vector<char> bytes(8 * columns.size());
+    for (size_t i = 0; i < columns.size(); i++) {
+      uint64_t bits;
+      std::memcpy(&bits, &columns[i], 8);
+      put_uint64(&bytes[8 * i], bits);
+    }
+    ofile.write(bytes.data(), std::streamsize(bytes.size()));
+    ofile.close();
+  }
+
+private:
+  using Row = std::pair<size_t, std::array<double, NUM_RESULT_COLUMNS>>;
+
+  size_t num_rows;
+  // Rows collected by each worker together with their grid indices
+  std::vector<std::vector<Row>> rows;
+  std::ofstream ofile;
+
+  // Store `val` at `dest` in little-endian byte order
+  static void put_uint64(char *dest, uint64_t val) {
+    for (size_t i = 0; i < 8; i++) {
+      dest[i] = char((val >> (8 * i)) & 0xFF);
+    }
+  }
+};
+
+} // namespace darksun
+
+#endif // DARKSUN_RESULT_SINK_HPP
@@ -6,143 +6,360 @@
 #define DARKSUN_SCANNER_HPP
 
 #include "darksun/darksun.hpp"
-#include <fstream>
+#include "darksun/result_sink.hpp"
+#include <algorithm>
+#include <atomic>
+#include <boost/timer/progress_display.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <functional>
-#include <mutex>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
 namespace darksun {
 
 using ModelSetter = std::function<bool(size_t, DarkSunParameters &)>;
+using ModelSolver = std::function<void(DarkSunParameters &)>;
+
+// Output formats for the results of a scan. See `CsvResultSink` and
+// `BinaryResultSink`.
+enum class OutputFormat { Csv, Binary };
+
+//===========================================================================
+//---- Work-stealing index dispenser ----------------------------------------
+//===========================================================================
+
+/**
+ * @brief Hands out the indices 0, ..., num - 1 to a fixed number of workers.
+ *
+ * Each worker starts with a contiguous block of indices and takes them one at
+ * a time from the front of its block. When its block is exhausted, the worker
+ * steals the back half of the largest remaining block. Blocks are stored as a
+ * packed [begin, end) pair in a single atomic, so taking an index is one
+ * uncontended compare-and-swap and no locks are ever taken. Slow regions of a
+ * scan are thereby spread over all workers instead of idling most of them at
+ * the end of the scan.
+ *
+ * If `num` is zero, the number of indices is unknown and the indices are
+ * handed out in order from a shared counter without bound.
+ */
+class IndexDispenser {
+public:
+  IndexDispenser(size_t num, size_t num_workers)
+      : num(num), num_workers(num_workers),
+        blocks(std::make_unique<Block[]>(num_workers)) {
+    if (num > UINT32_MAX) {
+      throw std::invalid_argument("IndexDispenser: too many indices");
+    }
+    for (size_t w = 0; w < num_workers; w++) {
+      blocks[w].bounds.store(pack(num * w / num_workers,
+                                  num * (w + 1) / num_workers),
+                             std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Get the next index for worker `worker`.
+   *
+   * @param worker Index of the worker, less than `num_workers`.
+   * @param idx Set to the next index.
+   * @return False if there are no indices left.
+   */
+  bool next(size_t worker, size_t &idx) {
+    if (num == 0) {
+      idx = counter.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    return pop_front(blocks[worker], idx) || steal(worker, idx);
+  }
+
+private:
+  struct alignas(64) Block {
+    std::atomic<uint64_t> bounds{0};
+  };
+
+  size_t num;
+  size_t num_workers;
+  std::unique_ptr<Block[]> blocks;
+  std::atomic<size_t> counter{0};
+
+  static uint64_t pack(uint64_t begin, uint64_t end) {
+    return (begin << 32) | end;
+  }
+  static uint64_t begin_of(uint64_t b) { return b >> 32; }
+  static uint64_t end_of(uint64_t b) { return b & UINT32_MAX; }
+
+  static bool pop_front(Block &block, size_t &idx) {
+    uint64_t cur = block.bounds.load(std::memory_order_acquire);
+    while (begin_of(cur) < end_of(cur)) {
+      const uint64_t nxt = pack(begin_of(cur) + 1, end_of(cur));
+      if (block.bounds.compare_exchange_weak(cur, nxt,
+                                             std::memory_order_acq_rel)) {
+        idx = begin_of(cur);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool steal(size_t worker, size_t &idx) {
+    while (true) {
+      // Find the worker with the most remaining indices
+      size_t victim = num_workers;
+      uint64_t cur = 0;
+      uint64_t most = 0;
+      for (size_t w = 0; w < num_workers; w++) {
+        const uint64_t b = blocks[w].bounds.load(std::memory_order_acquire);
+        if (begin_of(b) < end_of(b) && end_of(b) - begin_of(b) > most) {
+          most = end_of(b) - begin_of(b);
+          victim = w;
+          cur = b;
+        }
+      }
+      if (victim == num_workers) {
+        return false;
+      }
+      // Take the back half (rounded up) of the victim's block
+      const uint64_t mid = begin_of(cur) + most / 2;
+      if (blocks[victim].bounds.compare_exchange_strong(
+              cur, pack(begin_of(cur), mid), std::memory_order_acq_rel)) {
+        idx = mid;
+        blocks[worker].bounds.store(pack(mid + 1, end_of(cur)),
+                                    std::memory_order_release);
+        return true;
+      }
+    }
+  }
+};
+
+//===========================================================================
+//---- Scanner --------------------------------------------------------------
+//===========================================================================
 
 class Scanner {
 public:
   const std::string file_name;
   ModelSetter set_model;
+  // Number of points in the scan. If zero, the scan runs until `set_model`
+  // returns true.
+  size_t num_points;
+  // Number of threads used for the scan. If zero, the value of the
+  // environment variable DARKSUN_NUM_THREADS is used if set, otherwise the
+  // number of hardware threads.
+  size_t num_threads;
+  // If true and `num_points` is known, display a progress bar.
+  bool show_progress = true;
+  // Format of the output file
+  OutputFormat output_format = OutputFormat::Csv;
+  // If true, the rows of a CSV output file are sorted by grid index. Binary
+  // output is always sorted.
+  bool ordered_output = false;
+  // If true, keep a journal of the completed points next to the output file
+  // (see `journal_name`). If the scan is interrupted, running it again skips
+  // the completed points and appends the rest to the output file. A
+  // non-empty output file without a journal is never overwritten; `scan`
+  // throws instead. Only supported for CSV output.
+  bool resume = false;
+  // If true, the Boltzmann solver measures the time spent in each of its
+  // phases (see `DarkSunParameters::time_solver`). The total time spent on
+  // each point is always recorded.
+  bool time_solver = false;
+  // Function computing the derived quantities of each model. If it throws,
+  // the derived quantities are set to NaN.
+  ModelSolver solve_model = [](DarkSunParameters &params) {
+    solve_boltzmann(1e-7, 1e-7, params);
+  };
+  // If true, the relic density of each point is first estimated with
+  // `estimate_boltzmann`. Only points whose estimated rd_eta + rd_del lies
+  // within a factor `prescreen_band` of `prescreen_target` are passed on to
+  // `solve_model`. The others keep the estimated derived quantities and are
+  // flagged in the SKIPPED column of the output.
+  bool prescreen = false;
+  double prescreen_band = 100.0;
+  double prescreen_target = OMEGA_H2_CDM;
 
-  Scanner(const std::string &t_file_name, ModelSetter t_set_model)
-      : file_name(t_file_name), set_model(std::move(t_set_model)) {}
+  Scanner(const std::string &t_file_name, ModelSetter t_set_model,
+          size_t t_num_points = 0, size_t t_num_threads = 0)
+      : file_name(t_file_name), set_model(std::move(t_set_model)),
+        num_points(t_num_points), num_threads(t_num_threads) {}
 
   void scan();
 
+  /**
+   * @brief Compute the points of the scan and pass them to `sink`, which is
+   * neither opened nor closed. `sink` must accept `get_num_threads()`
+   * workers. `file_name`, `output_format`, `ordered_output` and `resume` are
+   * ignored.
+   */
+  void scan(ResultSink &sink);
+
+  /// Name of the journal used when `resume` is true.
+  std::string journal_name() const { return file_name + ".journal"; }
+
+  /// Number of threads used by `scan`.
+  size_t get_num_threads() const;
+
 private:
-  // Header for the output file
-  const std::string header =
-      "N,LAM,C,ADEL,LEC1,LEC2,MU_ETA,MU_DEL,XI_INF,XI_FO,TSM_FO,XI_CMB,XI_BBN,"
-      "RD_ETA,RD_DEL,DNEFF_CMB,DNEFF_BBN,ETA_SI_PER_MASS,DEL_SI_PER_MASS";
-  // Mutex for outputting data to file
-  std::mutex outmutex;
-  // Mutex for getting iter
-  std::mutex itermutex;
-  // Stream object for outputting data
-  std::ofstream ofile;
-
-  size_t iter = 0;
-  size_t get_iter();
-  void thread_scan();
+  // Destination of the results
+  ResultSink *sink = nullptr;
+  // Sorted indices of the points completed by an earlier, interrupted scan
+  std::vector<size_t> completed_points;
+
+  // Source of the indices of the points to compute
+  std::unique_ptr<IndexDispenser> dispenser;
+  // Number of points completed and number of threads still running
+  std::atomic<size_t> num_completed{0};
+  std::atomic<size_t> num_running{0};
+
+  void thread_scan(size_t worker);
+  bool skip_point(DarkSunParameters &params) const;
+  void display_progress();
 
   // Spawner for threads
-  std::thread spawn_thread_scan() {
-    return std::thread([this] { this->thread_scan(); });
+  std::thread spawn_thread_scan(size_t worker) {
+    return std::thread([this, worker] { this->thread_scan(worker); });
   }
-
-  void output_data(std::ofstream &ofile, const DarkSunParameters &params);
 };
 
-size_t Scanner::get_iter() {
-  // Lock function, get current iter, update iter and return value
-  std::lock_guard<std::mutex> lock(itermutex);
-  size_t it = iter;
-  iter++;
-  return it;
+size_t Scanner::get_num_threads() const {
+  if (num_threads > 0) {
+    return num_threads;
+  }
+  if (const char *env = std::getenv("DARKSUN_NUM_THREADS")) {
+    const long n = std::strtol(env, nullptr, 10);
+    if (n > 0) {
+      return size_t(n);
+    }
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
 }
 
-void Scanner::thread_scan() {
-  while (true) {
+/**
+ * @brief If `prescreen` is true, estimate the derived quantities of `params`
+ * and decide whether the point can skip the full solver.
+ *
+ * @return True if the estimated relic density lies outside the band around
+ * the target. Points whose estimate fails are never skipped.
+ */
+bool Scanner::skip_point(DarkSunParameters &params) const {
+  if (!prescreen) {
+    return false;
+  }
+  try {
+    estimate_boltzmann(params);
+  } catch (...) {
+    return false;
+  }
+  const double rd = params.rd_eta + params.rd_del;
+  params.skipped =
+      std::abs(log(rd / prescreen_target)) > log(prescreen_band);
+  return params.skipped;
+}
+
+void Scanner::thread_scan(size_t worker) {
+  size_t it;
+  while (dispenser->next(worker, it)) {
+    if (std::binary_search(completed_points.begin(), completed_points.end(),
+                           it)) {
+      num_completed.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
     auto params = DarkSunParameters{0, 0};
-    size_t it = get_iter();
+    params.time_solver = time_solver;
     if (set_model(it, params)) {
       break;
     }
-    try {
-      solve_boltzmann(1e-7, 1e-7, params);
-    } catch (...) {
-      params.xi_fo = NAN;
-      params.tsm_fo = NAN;
-      params.rd_eta = NAN;
-      params.rd_del = NAN;
-      params.xi_cmb = NAN;
-      params.xi_bbn = NAN;
-      params.dneff_cmb = NAN;
-      params.dneff_bbn = NAN;
-      params.eta_si_per_mass = NAN;
-      params.del_si_per_mass = NAN;
+    const auto start = std::chrono::steady_clock::now();
+    if (!skip_point(params)) {
+      try {
+        solve_model(params);
+      } catch (...) {
+        set_results_nan(params);
+      }
+    }
+    params.solve_time = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+    sink->write(worker, it, params);
+    num_completed.fetch_add(1, std::memory_order_relaxed);
+  }
+  num_running.fetch_sub(1, std::memory_order_release);
+}
+
+void Scanner::display_progress() {
+  // Poll the number of completed points so the workers never wait on the
+  // progress bar
+  boost::timer::progress_display progress(num_points);
+  while (true) {
+    const bool finished = num_running.load(std::memory_order_acquire) == 0;
+    const size_t done = num_completed.load(std::memory_order_relaxed);
+    if (done > progress.count()) {
+      progress += done - progress.count();
     }
-    output_data(ofile, params);
+    if (finished) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
   }
 }
 
 void Scanner::scan() {
-  // Reset the iter
-  iter = 0;
+  const size_t nthreads = get_num_threads();
 
-  // Open and make sure output file exists. If it does, write the header.
-  ofile.open(file_name);
-  if (ofile.is_open()) {
-    ofile << header;
+  // Open the output file, recovering the completed points if resuming
+  std::unique_ptr<ResultSink> file_sink;
+  std::vector<size_t> completed;
+  if (output_format == OutputFormat::Binary) {
+    if (resume) {
+      throw std::invalid_argument(
+          "Scanner: resuming is only supported for CSV output");
+    }
+    file_sink =
+        std::make_unique<BinaryResultSink>(file_name, nthreads, num_points);
+  } else if (resume) {
+    completed = recover_scan_journal(file_name, journal_name());
+    file_sink = std::make_unique<CsvResultSink>(
+        file_name, nthreads, ordered_output, journal_name(), completed);
   } else {
-    throw std::runtime_error("Cannot open file: " + file_name);
+    file_sink =
+        std::make_unique<CsvResultSink>(file_name, nthreads, ordered_output);
   }
 
-  // Function for threads to run
-  // auto f = [this]() { thread_scan(); };
+  completed_points = std::move(completed);
+  scan(*file_sink);
+  completed_points.clear();
+  file_sink->close();
+}
+
+void Scanner::scan(ResultSink &t_sink) {
+  const size_t nthreads = get_num_threads();
+  dispenser = std::make_unique<IndexDispenser>(num_points, nthreads);
+  num_completed = 0;
+  num_running = nthreads;
+  sink = &t_sink;
 
-  // Get the number of cpus
-  const auto cpu_count = std::thread::hardware_concurrency();
   // Create threads
-  std::vector<std::thread> threads(cpu_count);
+  std::vector<std::thread> threads(nthreads);
   // Launch the threads
-  for (auto &thread : threads) {
-    thread = spawn_thread_scan();
+  for (size_t w = 0; w < nthreads; w++) {
+    threads[w] = spawn_thread_scan(w);
+  }
+  if (show_progress && num_points > 0) {
+    display_progress();
   }
   // Wait for threads to finish
   for (auto &thread : threads) {
     thread.join();
   }
-
-  ofile.close();
+  sink = nullptr;
 }
 
-void Scanner::output_data(std::ofstream &ofile,
-                          const DarkSunParameters &params) {
-  // Lock this function to avoid data races
-  const std::lock_guard<std::mutex> lock(outmutex);
-  // Go to next line
-  ofile << std::endl;
-  // Model parameters
-  ofile << params.n << ",";
-  ofile << params.lam << ",";
-  ofile << params.c << ",";
-  ofile << params.adel << ",";
-  ofile << params.lec1 << ",";
-  ofile << params.lec2 << ",";
-  ofile << params.mu_eta << ",";
-  ofile << params.mu_del << ",";
-  ofile << params.xi_inf << ",";
-  // Derived parameters
-  ofile << params.xi_fo << ",";
-  ofile << params.tsm_fo << ",";
-  ofile << params.xi_cmb << ",";
-  ofile << params.xi_bbn << ",";
-  ofile << params.rd_eta << ",";
-  ofile << params.rd_del << ",";
-  ofile << params.dneff_cmb << ",";
-  ofile << params.dneff_bbn << ",";
-  ofile << params.eta_si_per_mass << ",";
-  ofile << params.del_si_per_mass;
-}
 } // namespace darksun
 
 #endif // DARKSUN_SCANNER_HPP
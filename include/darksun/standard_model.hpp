@@ -1,8 +1,9 @@
 #ifndef DARKSUN_STANDARD_MODEL_HPP
 #define DARKSUN_STANDARD_MODEL_HPP
 
+#include "darksun/interpolation.hpp"
 #include <boost/math/special_functions/pow.hpp>
-#include <gsl/gsl_spline.h>
+#include <cmath>
 
 namespace darksun {
 
@@ -24,33 +25,33 @@ private:
   static const double geff_data[341];
 
   // Internal functions
-  double i_geff(double tsm) {
+  double i_geff(double tsm) const {
     const double ltsm = log10(tsm);
     if (StandardModel::LOG_TEMP_MIN <= ltsm &&
         ltsm <= StandardModel::LOG_TEMP_MAX) {
-      return gsl_spline_eval(geff_spline, ltsm, acc_geff);
+      return geff_spline(ltsm);
     } else if (ltsm <= StandardModel::LOG_TEMP_MIN) {
       return GEFF_0;
     } else {
       return GEFF_INF;
     }
   }
-  double i_heff(double tsm) {
+  double i_heff(double tsm) const {
     const double ltsm = log10(tsm);
     if (StandardModel::LOG_TEMP_MIN <= ltsm &&
         ltsm <= StandardModel::LOG_TEMP_MAX) {
-      return gsl_spline_eval(heff_spline, ltsm, acc_heff);
+      return heff_spline(ltsm);
     } else if (ltsm <= StandardModel::LOG_TEMP_MIN) {
       return HEFF_0;
     } else {
       return HEFF_INF;
     }
   }
-  double i_sqrt_gstar(double tsm) {
+  double i_sqrt_gstar(double tsm) const {
     const double ltsm = log10(tsm);
     if (StandardModel::LOG_TEMP_MIN <= ltsm &&
         ltsm <= StandardModel::LOG_TEMP_MAX) {
-      return gsl_spline_eval(sqrt_gstar_spline, ltsm, acc_sqrt_gstar);
+      return sqrt_gstar_spline(ltsm);
     } else if (ltsm <= StandardModel::LOG_TEMP_MIN) {
       return SQRT_GSTAR_0;
     } else {
@@ -58,48 +59,26 @@ private:
     }
   }
 
-  // GSL cubic splines
-  gsl_spline *geff_spline;
-  gsl_spline *heff_spline;
-  gsl_spline *sqrt_gstar_spline;
-
-  // Accelerators
-  gsl_interp_accel *acc_geff;
-  gsl_interp_accel *acc_heff;
-  gsl_interp_accel *acc_sqrt_gstar;
+  // Cubic splines on the uniform log10(T) grid. These are never modified
+  // after construction, so they are safe to share between threads.
+  const UniformCubicSpline geff_spline;
+  const UniformCubicSpline heff_spline;
+  const UniformCubicSpline sqrt_gstar_spline;
 
   // Static instance of StandardModel class
-  static StandardModel sm;
-
-  StandardModel() {
-    geff_spline = gsl_spline_alloc(gsl_interp_cspline, 341);
-    heff_spline = gsl_spline_alloc(gsl_interp_cspline, 341);
-    sqrt_gstar_spline = gsl_spline_alloc(gsl_interp_cspline, 341);
-
-    acc_geff = gsl_interp_accel_alloc();
-    acc_heff = gsl_interp_accel_alloc();
-    acc_sqrt_gstar = gsl_interp_accel_alloc();
+  static const StandardModel sm;
 
-    gsl_spline_init(sqrt_gstar_spline, temps, sqrt_gstar_data, 341);
-    gsl_spline_init(heff_spline, temps, heff_data, 341);
-    gsl_spline_init(geff_spline, temps, geff_data, 341);
-  }
-  ~StandardModel() {
-    gsl_spline_free(geff_spline);
-    gsl_spline_free(heff_spline);
-    gsl_spline_free(sqrt_gstar_spline);
-
-    gsl_interp_accel_free(acc_geff);
-    gsl_interp_accel_free(acc_heff);
-    gsl_interp_accel_free(acc_sqrt_gstar);
-  }
+  StandardModel()
+      : geff_spline(LOG_TEMP_MIN, LOG_TEMP_STP, geff_data, 341),
+        heff_spline(LOG_TEMP_MIN, LOG_TEMP_STP, heff_data, 341),
+        sqrt_gstar_spline(LOG_TEMP_MIN, LOG_TEMP_STP, sqrt_gstar_data, 341) {}
 
 public:
   // Remove copy constructor to maintain single instance
   StandardModel(const StandardModel &) = delete;
 
   // Function to access static instance
-  static StandardModel &get_instance() { return sm; }
+  static const StandardModel &get_instance() { return sm; }
 
   static constexpr double HEFF_0 = 3.9387999991430975;
   static constexpr double HEFF_INF = 106.83;
@@ -120,7 +99,7 @@ public:
   }
 };
 
-StandardModel StandardModel::sm = StandardModel();
+const StandardModel StandardModel::sm = StandardModel();
 
 const double StandardModel::temps[341] = {-4.5,
                                           -4.475,
@@ -855,7 +834,7 @@ const double StandardModel::heff_data[341] = {3.9387999991430975,
                                               9.912168428652636,
                                               10.006323138799969,
                                               10.091400653807613,
-                                              0.168033928282645,
+                                              10.168033928282645,
                                               10.236900653727062,
                                               10.298569371753427,
                                               10.354000501799236,
@@ -13,6 +13,41 @@ struct StiffLinAlg {
   int mle, mue, mbjac, mbb, mdiag, mdiff, mbdiag;
 };
 
+/**
+ * @brief Work done by an integration. The times are wall-clock seconds and
+ * are only measured if requested from the solver, otherwise they are zero.
+ */
+struct SolverStats {
+  int nfcn = 0;          // Evaluations of the RHS
+  int njac = 0;          // Evaluations of the Jacobian
+  int nstep = 0;         // Computed steps
+  int naccpt = 0;        // Accepted steps
+  int nrejct = 0;        // Rejected steps (not counting those in the 1st step)
+  int ndec = 0;          // LU decompositions
+  int nsol = 0;          // Forward-backward substitutions
+  double time_fcn = 0.0; // Time spent evaluating the RHS
+  double time_jac = 0.0; // Time spent evaluating the Jacobian
+  double time_dec = 0.0; // Time spent in LU decompositions
+  double time_sol = 0.0; // Time spent in forward-backward substitutions
+
+  /// Add the work of another integration, e.g. a later phase of the same
+  /// solution.
+  SolverStats &operator+=(const SolverStats &other) {
+    nfcn += other.nfcn;
+    njac += other.njac;
+    nstep += other.nstep;
+    naccpt += other.naccpt;
+    nrejct += other.nrejct;
+    ndec += other.ndec;
+    nsol += other.nsol;
+    time_fcn += other.time_fcn;
+    time_jac += other.time_jac;
+    time_dec += other.time_dec;
+    time_sol += other.time_sol;
+    return *this;
+  }
+};
+
 using F_fcn = std::function<void(int *, double *, double *, double *)>;
 using F_jac = std::function<void(int *, double *, double *, double *, int *)>;
 using F_mas = std::function<void(int *, double *, int *)>;
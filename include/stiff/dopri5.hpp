@@ -0,0 +1,331 @@
+#ifndef STIFF_DOPRI5_HPP
+#define STIFF_DOPRI5_HPP
+
+#include "stiff/common.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+namespace stiff {
+
+//===========================================================================
+//---- Explicit Runge-Kutta method DOPRI5 with stiffness detection ----------
+//===========================================================================
+
+/// Coefficients of the Dormand-Prince method of order 5(4) and of its dense
+/// output of order 4.
+struct Dopri5Coefficients {
+  static constexpr double c2 = 0.2;
+  static constexpr double c3 = 0.3;
+  static constexpr double c4 = 0.8;
+  static constexpr double c5 = 8.0 / 9.0;
+  static constexpr double a21 = 0.2;
+  static constexpr double a31 = 3.0 / 40.0;
+  static constexpr double a32 = 9.0 / 40.0;
+  static constexpr double a41 = 44.0 / 45.0;
+  static constexpr double a42 = -56.0 / 15.0;
+  static constexpr double a43 = 32.0 / 9.0;
+  static constexpr double a51 = 19372.0 / 6561.0;
+  static constexpr double a52 = -25360.0 / 2187.0;
+  static constexpr double a53 = 64448.0 / 6561.0;
+  static constexpr double a54 = -212.0 / 729.0;
+  static constexpr double a61 = 9017.0 / 3168.0;
+  static constexpr double a62 = -355.0 / 33.0;
+  static constexpr double a63 = 46732.0 / 5247.0;
+  static constexpr double a64 = 49.0 / 176.0;
+  static constexpr double a65 = -5103.0 / 18656.0;
+  static constexpr double a71 = 35.0 / 384.0;
+  static constexpr double a73 = 500.0 / 1113.0;
+  static constexpr double a74 = 125.0 / 192.0;
+  static constexpr double a75 = -2187.0 / 6784.0;
+  static constexpr double a76 = 11.0 / 84.0;
+  static constexpr double e1 = 71.0 / 57600.0;
+  static constexpr double e3 = -71.0 / 16695.0;
+  static constexpr double e4 = 71.0 / 1920.0;
+  static constexpr double e5 = -17253.0 / 339200.0;
+  static constexpr double e6 = 22.0 / 525.0;
+  static constexpr double e7 = -1.0 / 40.0;
+  static constexpr double d1 = -12715105075.0 / 11282082432.0;
+  static constexpr double d3 = 87487479700.0 / 32700410799.0;
+  static constexpr double d4 = -10690763975.0 / 1880347072.0;
+  static constexpr double d5 = 701980252875.0 / 199316789632.0;
+  static constexpr double d6 = -1453857185.0 / 822651844.0;
+  static constexpr double d7 = 69997945.0 / 29380423.0;
+};
+
+/**
+ * @brief Explicit Runge-Kutta integrator of Dormand and Prince (order 5 with
+ * an embedded order 4 error estimate) for non-stiff systems of fixed
+ * dimension N, following Hairer's DOPRI5.
+ *
+ * The callbacks are those of `Radau5::integrate` without the Jacobian:
+ *
+ *   fcn(double x, const Vector &y, Vector &dy)
+ *   solout(int nr, double xold, double x, const Vector &y,
+ *          const Dopri5 &solver) -> bool
+ *
+ * Every `nstiff` accepted steps, h times the dominant eigenvalue of the
+ * Jacobian is estimated from the last two stages. If it lies outside the
+ * stability region for 15 of the following accepted steps, the integration
+ * stops with return code -4, so that the caller can switch to an implicit
+ * method.
+ */
+template <size_t N> class Dopri5 : private Dopri5Coefficients {
+public:
+  using Vector = std::array<double, N>;
+
+  // Relative and absolute tolerances
+  double rtol = 1e-6;
+  double atol = 1e-6;
+  // Maximal step size. If zero, the length of the integration interval.
+  double hmax = 0.0;
+  // Maximal number of steps
+  int nmax = 100000;
+  // Number of accepted steps between two tests for stiffness. If zero,
+  // stiffness is never tested.
+  int nstiff = 1000;
+  // Rounding unit, safety factor for the step size, exponent of the
+  // stabilized step-size controller and bounds on the step-size ratio
+  // h / hnew.
+  double uround = 1e-16;
+  double safe = 0.9;
+  double beta = 0.04;
+  double facl = 5.0;
+  double facr = 0.1;
+
+  // If true, measure the time spent in the RHS
+  bool timing = false;
+
+  // Statistics of the last integration
+  SolverStats stats;
+
+  /**
+   * @brief Integrate y' = fcn(x, y) from `x` to `xend`.
+   *
+   * @param x Initial value of x. Set to the last x reached.
+   * @param y Initial value of y. Set to the solution at x.
+   * @param h Initial step size. Set to the predicted next step size.
+   * @return 1 if successful, 2 if interrupted by `solout`, -2 if more than
+   * `nmax` steps are needed, -3 if the step size becomes too small and -4 if
+   * the problem is found to be stiff.
+   */
+  template <class Fcn, class Solout>
+  int integrate(Fcn &&fcn, double &x, Vector &y, double xend, double &h,
+                Solout &&solout);
+
+  /// Value of the `i`th component of the dense output of the last accepted
+  /// step at `x`.
+  double dense(size_t i, double x) const {
+    const double t = 1.0 + (x - xsol) / hsol;
+    const double t1 = 1.0 - t;
+    return cont[0][i] +
+           t * (cont[1][i] +
+                t1 * (cont[2][i] + t * (cont[3][i] + t1 * cont[4][i])));
+  }
+
+  /// Last point reached and size of the last accepted step
+  double get_x() const { return xsol; }
+  double get_h() const { return hsol; }
+
+private:
+  // Stages and scratch space
+  std::array<Vector, 7> k{};
+  Vector ynew{};
+  Vector ysti{};
+  // Coefficients of the dense output of the last accepted step
+  std::array<Vector, 5> cont{};
+  double xsol = 0.0;
+  double hsol = 1.0;
+
+  // Evaluate the RHS, timing it if `timing` is set
+  template <class Fcn>
+  void rhs(Fcn &fcn, double x, const Vector &y, Vector &dy) {
+    ++stats.nfcn;
+    if (!timing) {
+      fcn(x, y, dy);
+      return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    fcn(x, y, dy);
+    stats.time_fcn += std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+  }
+};
+
+template <size_t N>
+template <class Fcn, class Solout>
+int Dopri5<N>::integrate(Fcn &&fcn, double &x, Vector &y, double xend,
+                         double &h, Solout &&solout) {
+  stats = SolverStats{};
+
+  const double posneg = std::copysign(1.0, xend - x);
+  const double hmaxn = hmax == 0.0
+                           ? std::abs(xend - x)
+                           : std::min(std::abs(hmax), std::abs(xend - x));
+  const double expo1 = 0.2 - beta * 0.75;
+  if (std::abs(h) <= 10.0 * uround) {
+    h = 1e-6;
+  }
+  h = posneg * std::min(std::abs(h), hmaxn);
+  double facold = 1e-4;
+  bool reject = false;
+  bool last = false;
+  int iasti = 0;
+  int nonsti = 0;
+
+  for (size_t i = 0; i < N; i++) {
+    cont[0][i] = y[i];
+    cont[1][i] = cont[2][i] = cont[3][i] = cont[4][i] = 0.0;
+  }
+  xsol = x;
+  hsol = h;
+  if (!solout(stats.naccpt + 1, x, x, static_cast<const Vector &>(y),
+              static_cast<const Dopri5 &>(*this))) {
+    return 2;
+  }
+  rhs(fcn, x, y, k[0]);
+
+  while (true) {
+    ++stats.nstep;
+    if (stats.nstep > nmax) {
+      std::cerr << "More than " << nmax << " steps needed\n";
+      return -2;
+    }
+    if (0.1 * std::abs(h) <= std::abs(x) * uround) {
+      std::cerr << "Step-size too small: h = " << h << "\n";
+      return -3;
+    }
+    if ((x + 1.01 * h - xend) * posneg > 0.0) {
+      h = xend - x;
+      last = true;
+    }
+
+    // The stages
+    for (size_t i = 0; i < N; i++) {
+      ynew[i] = y[i] + h * a21 * k[0][i];
+    }
+    rhs(fcn, x + c2 * h, ynew, k[1]);
+    for (size_t i = 0; i < N; i++) {
+      ynew[i] = y[i] + h * (a31 * k[0][i] + a32 * k[1][i]);
+    }
+    rhs(fcn, x + c3 * h, ynew, k[2]);
+    for (size_t i = 0; i < N; i++) {
+      ynew[i] = y[i] + h * (a41 * k[0][i] + a42 * k[1][i] + a43 * k[2][i]);
+    }
+    rhs(fcn, x + c4 * h, ynew, k[3]);
+    for (size_t i = 0; i < N; i++) {
+      ynew[i] = y[i] + h * (a51 * k[0][i] + a52 * k[1][i] + a53 * k[2][i] +
+                            a54 * k[3][i]);
+    }
+    rhs(fcn, x + c5 * h, ynew, k[4]);
+    for (size_t i = 0; i < N; i++) {
+      ysti[i] = y[i] + h * (a61 * k[0][i] + a62 * k[1][i] + a63 * k[2][i] +
+                            a64 * k[3][i] + a65 * k[4][i]);
+    }
+    const double xph = x + h;
+    rhs(fcn, xph, ysti, k[5]);
+    for (size_t i = 0; i < N; i++) {
+      ynew[i] = y[i] + h * (a71 * k[0][i] + a73 * k[2][i] + a74 * k[3][i] +
+                            a75 * k[4][i] + a76 * k[5][i]);
+    }
+    rhs(fcn, xph, ynew, k[6]);
+
+    // Error estimation
+    double err = 0.0;
+    for (size_t i = 0; i < N; i++) {
+      const double sk =
+          atol + rtol * std::max(std::abs(y[i]), std::abs(ynew[i]));
+      const double e = h *
+                       (e1 * k[0][i] + e3 * k[2][i] + e4 * k[3][i] +
+                        e5 * k[4][i] + e6 * k[5][i] + e7 * k[6][i]) /
+                       sk;
+      err += e * e;
+    }
+    err = sqrt(err / double(N));
+
+    // Computation of hnew with the stabilized controller. We require
+    // 0.2 <= hnew / h <= 10.
+    const double fac11 = pow(err, expo1);
+    double fac = fac11 / pow(facold, beta);
+    fac = std::max(facr, std::min(facl, fac / safe));
+    double hnew = h / fac;
+
+    if (!(err <= 1.0)) {
+      // Step is rejected
+      hnew = h / std::min(facl, fac11 / safe);
+      reject = true;
+      last = false;
+      if (stats.naccpt >= 1) {
+        ++stats.nrejct;
+      }
+      h = hnew;
+      continue;
+    }
+
+    // Step is accepted
+    facold = std::max(err, 1e-4);
+    ++stats.naccpt;
+
+    // Stiffness detection
+    if (nstiff > 0 && (stats.naccpt % nstiff == 0 || iasti > 0)) {
+      double stnum = 0.0;
+      double stden = 0.0;
+      for (size_t i = 0; i < N; i++) {
+        stnum += (k[6][i] - k[5][i]) * (k[6][i] - k[5][i]);
+        stden += (ynew[i] - ysti[i]) * (ynew[i] - ysti[i]);
+      }
+      if (stden > 0.0 && std::abs(h) * sqrt(stnum / stden) > 3.25) {
+        nonsti = 0;
+        ++iasti;
+      } else if (++nonsti == 6) {
+        iasti = 0;
+      }
+    }
+
+    // Dense output
+    for (size_t i = 0; i < N; i++) {
+      const double ydiff = ynew[i] - y[i];
+      const double bspl = h * k[0][i] - ydiff;
+      cont[0][i] = y[i];
+      cont[1][i] = ydiff;
+      cont[2][i] = bspl;
+      cont[3][i] = ydiff - h * k[6][i] - bspl;
+      cont[4][i] = h * (d1 * k[0][i] + d3 * k[2][i] + d4 * k[3][i] +
+                        d5 * k[4][i] + d6 * k[5][i] + d7 * k[6][i]);
+    }
+    const double xold = x;
+    k[0] = k[6];
+    y = ynew;
+    x = xph;
+    xsol = x;
+    hsol = h;
+    if (!solout(stats.naccpt + 1, xold, x, static_cast<const Vector &>(y),
+                static_cast<const Dopri5 &>(*this))) {
+      return 2;
+    }
+    if (last) {
+      h = hnew;
+      return 1;
+    }
+    if (iasti == 15) {
+      h = hnew;
+      return -4;
+    }
+    if (std::abs(hnew) > hmaxn) {
+      hnew = posneg * hmaxn;
+    }
+    if (reject) {
+      hnew = posneg * std::min(std::abs(hnew), std::abs(h));
+    }
+    reject = false;
+    h = hnew;
+  }
+}
+
+} // namespace stiff
+
+#endif // STIFF_DOPRI5_HPP
@@ -0,0 +1,179 @@
+#ifndef STIFF_DUAL_HPP
+#define STIFF_DUAL_HPP
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace stiff {
+
+//===========================================================================
+//---- Forward-mode automatic differentiation -------------------------------
+//===========================================================================
+
+// The dual numbers and their elementary functions live in their own
+// namespace, where argument-dependent lookup finds them, so that they do not
+// hide the functions of <cmath> for unqualified calls in `stiff`.
+namespace ad {
+
+/**
+ * @brief Dual number carrying a value and its derivatives with respect to
+ * N independent variables.
+ *
+ * Code templated on its scalar type and evaluated on `Dual<N>` computes its
+ * derivatives alongside its value, which is used by `jacobian` to obtain
+ * exact Jacobians from the RHS alone.
+ */
+template <size_t N> struct Dual {
+  double val = 0.0;
+  std::array<double, N> der{};
+
+  Dual() = default;
+  // Constants have vanishing derivatives
+  Dual(double t_val) : val(t_val) {}
+
+  /// The `i`th independent variable, with value `t_val`.
+  static Dual variable(double t_val, size_t i) {
+    Dual d(t_val);
+    d.der[i] = 1.0;
+    return d;
+  }
+
+  Dual &operator+=(const Dual &b) {
+    val += b.val;
+    for (size_t i = 0; i < N; i++) {
+      der[i] += b.der[i];
+    }
+    return *this;
+  }
+  Dual &operator-=(const Dual &b) {
+    val -= b.val;
+    for (size_t i = 0; i < N; i++) {
+      der[i] -= b.der[i];
+    }
+    return *this;
+  }
+  Dual &operator*=(const Dual &b) {
+    for (size_t i = 0; i < N; i++) {
+      der[i] = der[i] * b.val + val * b.der[i];
+    }
+    val *= b.val;
+    return *this;
+  }
+  Dual &operator/=(const Dual &b) {
+    const double inv = 1.0 / b.val;
+    val *= inv;
+    for (size_t i = 0; i < N; i++) {
+      der[i] = (der[i] - val * b.der[i]) * inv;
+    }
+    return *this;
+  }
+};
+
+template <size_t N> Dual<N> operator-(Dual<N> a) {
+  a.val = -a.val;
+  for (auto &d : a.der) {
+    d = -d;
+  }
+  return a;
+}
+template <size_t N> Dual<N> operator+(Dual<N> a, const Dual<N> &b) {
+  return a += b;
+}
+template <size_t N> Dual<N> operator-(Dual<N> a, const Dual<N> &b) {
+  return a -= b;
+}
+template <size_t N> Dual<N> operator*(Dual<N> a, const Dual<N> &b) {
+  return a *= b;
+}
+template <size_t N> Dual<N> operator/(Dual<N> a, const Dual<N> &b) {
+  return a /= b;
+}
+template <size_t N> Dual<N> operator+(Dual<N> a, double b) {
+  a.val += b;
+  return a;
+}
+template <size_t N> Dual<N> operator+(double a, Dual<N> b) {
+  b.val += a;
+  return b;
+}
+template <size_t N> Dual<N> operator-(Dual<N> a, double b) {
+  a.val -= b;
+  return a;
+}
+template <size_t N> Dual<N> operator-(double a, const Dual<N> &b) {
+  return -b + a;
+}
+template <size_t N> Dual<N> operator*(Dual<N> a, double b) {
+  a.val *= b;
+  for (auto &d : a.der) {
+    d *= b;
+  }
+  return a;
+}
+template <size_t N> Dual<N> operator*(double a, const Dual<N> &b) {
+  return b * a;
+}
+template <size_t N> Dual<N> operator/(const Dual<N> &a, double b) {
+  return a * (1.0 / b);
+}
+template <size_t N> Dual<N> operator/(double a, const Dual<N> &b) {
+  return Dual<N>(a) / b;
+}
+
+// Elementary functions: value f(a) and derivatives f'(a) * da
+template <size_t N> Dual<N> dual_chain(const Dual<N> &a, double f, double df) {
+  Dual<N> r(f);
+  for (size_t i = 0; i < N; i++) {
+    r.der[i] = df * a.der[i];
+  }
+  return r;
+}
+template <size_t N> Dual<N> exp(const Dual<N> &a) {
+  const double e = std::exp(a.val);
+  return dual_chain(a, e, e);
+}
+template <size_t N> Dual<N> log(const Dual<N> &a) {
+  return dual_chain(a, std::log(a.val), 1.0 / a.val);
+}
+template <size_t N> Dual<N> sqrt(const Dual<N> &a) {
+  const double s = std::sqrt(a.val);
+  return dual_chain(a, s, 0.5 / s);
+}
+template <size_t N> Dual<N> pow(const Dual<N> &a, double p) {
+  const double f = std::pow(a.val, p);
+  return dual_chain(a, f, p * std::pow(a.val, p - 1.0));
+}
+
+} // namespace ad
+
+using ad::Dual;
+
+/**
+ * @brief Compute the Jacobian dfy[i][j] = df_i/dy_j of `fcn` at (x, y) by
+ * forward-mode automatic differentiation.
+ *
+ * `fcn` must accept `fcn(x, const std::array<Dual<N>, N> &y,
+ * std::array<Dual<N>, N> &dy)`, typically by being a generic lambda or a
+ * template over the scalar type. Its value and all N derivatives are
+ * computed in a single evaluation.
+ */
+template <size_t N, class Fcn>
+void jacobian(Fcn &&fcn, double x, const std::array<double, N> &y,
+              std::array<std::array<double, N>, N> &dfy) {
+  std::array<Dual<N>, N> yd;
+  std::array<Dual<N>, N> dyd;
+  for (size_t j = 0; j < N; j++) {
+    yd[j] = Dual<N>::variable(y[j], j);
+  }
+  fcn(x, static_cast<const std::array<Dual<N>, N> &>(yd), dyd);
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      dfy[i][j] = dyd[i].der[j];
+    }
+  }
+}
+
+} // namespace stiff
+
+#endif // STIFF_DUAL_HPP
@@ -0,0 +1,114 @@
+#ifndef STIFF_EVENTS_HPP
+#define STIFF_EVENTS_HPP
+
+#include <cmath>
+
+namespace stiff {
+
+//===========================================================================
+//---- Location of events on the dense output -------------------------------
+//===========================================================================
+
+/**
+ * @brief Event defined by a sign change of an event function g along the
+ * solution of an ODE.
+ *
+ * `check` is called from `solout` after every accepted step, with g given as
+ * a function of x alone, evaluated on the dense output of the solver, e.g.
+ *
+ *   event.check(xold, x, [&](double t) {
+ *     return solver.dense(0, t) - threshold(t);
+ *   });
+ *
+ * When g changes sign over the step, the crossing is located on the dense
+ * output with the Illinois variant of regula falsi, so the location does not
+ * depend on where the steps happen to end. An event marked `once` never
+ * fires again after its first crossing, and g is no longer evaluated.
+ */
+class Event {
+public:
+  // Tolerance on the location of the event, relative to max(1, |x|)
+  double xtol = 1e-10;
+  // If true, the event fires at most once
+  bool once = true;
+
+  /// Forget the previous steps and crossings, e.g. for a new integration.
+  void reset() {
+    has_prev = false;
+    fired = false;
+    xevent = NAN;
+  }
+
+  /**
+   * @brief Look for a sign change of `g` over the accepted step from `xold`
+   * to `x`. `g(t)` must be valid for t in [xold, x].
+   *
+   * @return True if the event fires during the step. Its location is then
+   * given by `location()`.
+   */
+  template <class G> bool check(double xold, double x, G &&g);
+
+  /// True if the event has fired since the last reset
+  bool has_fired() const { return fired; }
+  /// Location of the last crossing, NaN if the event has not fired
+  double location() const { return xevent; }
+
+private:
+  bool has_prev = false;
+  bool fired = false;
+  double xprev = 0.0;
+  double gprev = 0.0;
+  double xevent = NAN;
+};
+
+template <class G> bool Event::check(double xold, double x, G &&g) {
+  if (once && fired) {
+    return false;
+  }
+  // The value at the start of the step is normally that of the end of the
+  // previous step
+  double ga = has_prev && xprev == xold ? gprev : g(xold);
+  const double gb = g(x);
+  has_prev = true;
+  xprev = x;
+  gprev = gb;
+  if (xold == x || (ga < 0.0) == (gb < 0.0)) {
+    return false;
+  }
+
+  // Illinois algorithm on [xold, x]
+  double a = xold;
+  double b = x;
+  double fb = gb;
+  const double tol = xtol * std::fmax(1.0, std::fabs(x));
+  int side = 0;
+  for (int it = 0; it < 100 && std::fabs(b - a) > tol; it++) {
+    const double c = (a * fb - b * ga) / (fb - ga);
+    const double fc = g(c);
+    if ((fc < 0.0) == (fb < 0.0)) {
+      b = c;
+      fb = fc;
+      if (side == -1) {
+        ga *= 0.5;
+      }
+      side = -1;
+    } else {
+      a = c;
+      ga = fc;
+      if (side == 1) {
+        fb *= 0.5;
+      }
+      side = 1;
+    }
+    if (fc == 0.0) {
+      a = b = c;
+    }
+  }
+  xevent = 0.5 * (a + b);
+  fired = true;
+  return true;
+}
+
+} // namespace stiff
+
+#endif // STIFF_EVENTS_HPP
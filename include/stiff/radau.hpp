@@ -8,7 +8,11 @@
 #include "stiff/common.hpp"
 #include "stiff/dc_decsol.hpp"
 #include "stiff/decsol.hpp"
+#include <algorithm>
+#include <array>
 #include <iostream>
+#include <utility>
+#include <vector>
 
 namespace stiff {
 
@@ -216,6 +220,27 @@ int coertv(int *nsmax, RadauCoe3 &coe3, RadauCoe5 &coe5, RadauCoe7 &coe7) {
   return 0;
 }
 
+// Transformation matrices of the 3-, 5- and 7-stage methods
+struct RadauCoefficients {
+  RadauCoe3 coe3;
+  RadauCoe5 coe5;
+  RadauCoe7 coe7;
+};
+
+/**
+ * @brief Transformation matrices of all the methods used by `radau`. They are
+ * filled by `coertv` on first use and shared by all subsequent integrations.
+ */
+const RadauCoefficients &radau_coefficients() {
+  static const RadauCoefficients coefficients = [] {
+    RadauCoefficients c{};
+    int nsmax = 7;
+    coertv(&nsmax, c.coe3, c.coe5, c.coe7);
+    return c;
+  }();
+  return coefficients;
+}
+
 int coercv(int *ns, double *c__, double *dd, double *u1, double *alph,
            double *beta) {
   /* System generated locals */
@@ -344,10 +369,11 @@ double contra(int *i__, double *x, double *cont, int * /*lrc*/,
 //---- Radau Core Integrator ------------------------------------------------
 //===========================================================================
 
-int radcov(int *n, F_fcn fcn, double *x, double *y, double *xend, double *hmax,
+template <class Fcn, class Jac, class Mas, class Solout>
+int radcov(int *n, Fcn &fcn, double *x, double *y, double *xend, double *hmax,
            double *h__, double *rtol, double *atol, int *itol, int *ns,
-           F_jac jac, int *ijac, int *mljac, int *mujac, F_mas mas, int *mlmas,
-           int *mumas, F_solout solout, int *iout, int *idid, int *nmax,
+           Jac &jac, int *ijac, int *mljac, int *mujac, Mas &mas, int *mlmas,
+           int *mumas, Solout &solout, int *iout, int *idid, int *nmax,
            double *uround, double *safe, double *thet, double *quot1,
            double *quot2, int *nit1, int *ijob, bool *startn, int *nind1,
            int *nind2, int *nind3, bool *pred, double *facl, double *facr,
@@ -485,10 +511,10 @@ int radcov(int *n, F_fcn fcn, double *x, double *y, double *xend, double *hmax,
   weight_1.ns = *ns;
   lrc = nns + *n;
 
-  RadauCoe3 coe3;
-  RadauCoe5 coe5;
-  RadauCoe7 coe7;
-  coertv(nsmax, coe3, coe5, coe7);
+  const RadauCoefficients &coefficients = radau_coefficients();
+  const RadauCoe3 &coe3 = coefficients.coe3;
+  const RadauCoe5 &coe5 = coefficients.coe5;
+  const RadauCoe7 &coe7 = coefficients.coe7;
   coercv(ns, weight_1.c__, dd, &u1, alph, beta);
   if (*m1 > 0) {
     *ijob += 10;
@@ -1692,10 +1718,19 @@ L179:
 //---- Radau Integrator Interface -------------------------------------------
 //===========================================================================
 
-int radau(int *n, F_fcn fcn, double *x, double *y, double *xend, double *h__,
-          double *rtol, double *atol, int *itol, F_jac jac, int *ijac,
-          int *mljac, int *mujac, F_mas mas, int *imas, int *mlmas, int *mumas,
-          F_solout solout, int *iout, double *work, int *lwork, int *iwork,
+/**
+ * @brief Solve a stiff (or differential-algebraic) system of ODEs using the
+ * implicit Runge-Kutta method RADAU with variable order (5, 9 or 13).
+ *
+ * The callbacks `fcn`, `jac`, `mas` and `solout` may be any callables with
+ * the signatures of `F_fcn`, `F_jac`, `F_mas` and `F_solout`. They are called
+ * directly, so lambdas are inlined into the integrator.
+ */
+template <class Fcn, class Jac, class Mas, class Solout>
+int radau(int *n, Fcn &&fcn, double *x, double *y, double *xend, double *h__,
+          double *rtol, double *atol, int *itol, Jac &&jac, int *ijac,
+          int *mljac, int *mujac, Mas &&mas, int *imas, int *mlmas, int *mumas,
+          Solout &&solout, int *iout, double *work, int *lwork, int *iwork,
           int *liwork, int *idid) {
   /* System generated locals */
   int i__1;
@@ -2062,6 +2097,95 @@ int radau(int *n, F_fcn fcn, double *x, double *y, double *xend, double *h__,
   return 0;
 }
 
+/**
+ * @brief Solve a stiff system of ODEs using RADAU with type-erased callbacks.
+ *
+ * Thin adapter over the templated `radau` for callers holding
+ * `std::function`s.
+ */
+int radau(int *n, F_fcn fcn, double *x, double *y, double *xend, double *h__,
+          double *rtol, double *atol, int *itol, F_jac jac, int *ijac,
+          int *mljac, int *mujac, F_mas mas, int *imas, int *mlmas, int *mumas,
+          F_solout solout, int *iout, double *work, int *lwork, int *iwork,
+          int *liwork, int *idid) {
+  return radau<F_fcn &, F_jac &, F_mas &, F_solout &>(
+      n, fcn, x, y, xend, h__, rtol, atol, itol, jac, ijac, mljac, mujac, mas,
+      imas, mlmas, mumas, solout, iout, work, lwork, iwork, liwork, idid);
+}
+
+//===========================================================================
+//---- Reusable RADAU workspace ---------------------------------------------
+//===========================================================================
+
+/**
+ * @brief Workspace of `radau` which can be reused across many integrations
+ * of systems of the same dimension.
+ *
+ * The `work` and `iwork` arrays are allocated once in the constructor. The
+ * optional inputs of `radau` (work[0..19] and iwork[0..19], see `radau`) are
+ * kept in `options` and `int_options` and copied into the workspace before
+ * every call, so resetting between problems costs 40 stores and a call never
+ * sees the outputs of the previous one.
+ */
+class RadauSolver {
+public:
+  // Optional real and integer inputs of `radau`. Zero selects the default.
+  std::array<double, 20> options{};
+  std::array<int, 20> int_options{};
+
+  /**
+   * @param n Dimension of the systems to be solved.
+   * @param nsmax Maximal number of stages (3, 5 or 7).
+   */
+  explicit RadauSolver(int n, int nsmax = 7)
+      : n(n), lwork((nsmax + 1) * n * n + (3 * nsmax + 3) * n + 20),
+        liwork((2 + (nsmax - 1) / 2) * n + 20), work(lwork), iwork(liwork) {
+    int_options[11] = nsmax;
+  }
+
+  /// Dimension of the systems this solver was built for.
+  int dimension() const { return n; }
+
+  /// Statistics of the last call to `solve`. No times are measured.
+  SolverStats stats() const {
+    SolverStats stats;
+    stats.nfcn = iwork[13];
+    stats.njac = iwork[14];
+    stats.nstep = iwork[15];
+    stats.naccpt = iwork[16];
+    stats.nrejct = iwork[17];
+    stats.ndec = iwork[18];
+    stats.nsol = iwork[19];
+    return stats;
+  }
+
+  /**
+   * @brief Solve a system of dimension `dimension()` with `radau`. The
+   * arguments are those of `radau` without the workspace.
+   */
+  template <class Fcn, class Jac, class Mas, class Solout>
+  int solve(Fcn &&fcn, double *x, double *y, double *xend, double *h__,
+            double *rtol, double *atol, int *itol, Jac &&jac, int *ijac,
+            int *mljac, int *mujac, Mas &&mas, int *imas, int *mlmas,
+            int *mumas, Solout &&solout, int *iout, int *idid) {
+    std::copy(options.begin(), options.end(), work.begin());
+    std::copy(int_options.begin(), int_options.end(), iwork.begin());
+    int nd = n;
+    return radau(&nd, std::forward<Fcn>(fcn), x, y, xend, h__, rtol, atol,
+                 itol, std::forward<Jac>(jac), ijac, mljac, mujac,
+                 std::forward<Mas>(mas), imas, mlmas, mumas,
+                 std::forward<Solout>(solout), iout, work.data(), &lwork,
+                 iwork.data(), &liwork, idid);
+  }
+
+private:
+  int n;
+  int lwork;
+  int liwork;
+  std::vector<double> work;
+  std::vector<int> iwork;
+};
+
 } // namespace stiff
 
 #endif // STIFF_RADAU_HPP
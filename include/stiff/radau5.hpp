@@ -0,0 +1,802 @@
+#ifndef STIFF_RADAU5_HPP
+#define STIFF_RADAU5_HPP
+
+#include "stiff/common.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+namespace stiff {
+
+//===========================================================================
+//---- LU decompositions of small fixed-size matrices -----------------------
+//===========================================================================
+
+/**
+ * @brief LU decomposition with partial pivoting of a real N x N matrix.
+ * All storage is inline, and all loop bounds are compile-time constants.
+ */
+template <size_t N> class SmallRealLU {
+public:
+  using Vector = std::array<double, N>;
+  using Matrix = std::array<Vector, N>;
+
+  /**
+   * @brief Decompose `fac * 1 - jac`.
+   * @return False if the matrix is singular.
+   */
+  bool decompose(double fac, const Matrix &jac) {
+    for (size_t i = 0; i < N; i++) {
+      for (size_t j = 0; j < N; j++) {
+        a[i][j] = -jac[i][j];
+      }
+      a[i][i] += fac;
+    }
+    for (size_t k = 0; k < N; k++) {
+      size_t m = k;
+      for (size_t i = k + 1; i < N; i++) {
+        if (std::abs(a[i][k]) > std::abs(a[m][k])) {
+          m = i;
+        }
+      }
+      ip[k] = m;
+      if (m != k) {
+        std::swap(a[m], a[k]);
+      }
+      if (a[k][k] == 0.0) {
+        return false;
+      }
+      const double inv = 1.0 / a[k][k];
+      for (size_t i = k + 1; i < N; i++) {
+        a[i][k] *= inv;
+        for (size_t j = k + 1; j < N; j++) {
+          a[i][j] -= a[i][k] * a[k][j];
+        }
+      }
+    }
+    return true;
+  }
+
+  /// Overwrite `b` with the solution of the decomposed system.
+  void solve(Vector &b) const {
+    for (size_t k = 0; k < N; k++) {
+      std::swap(b[k], b[ip[k]]);
+      for (size_t i = k + 1; i < N; i++) {
+        b[i] -= a[i][k] * b[k];
+      }
+    }
+    for (size_t k = N; k-- > 0;) {
+      for (size_t j = k + 1; j < N; j++) {
+        b[k] -= a[k][j] * b[j];
+      }
+      b[k] /= a[k][k];
+    }
+  }
+
+private:
+  Matrix a{};
+  std::array<size_t, N> ip{};
+};
+
+/**
+ * @brief Specialization for 2 x 2 matrices storing the explicit inverse.
+ */
+template <> class SmallRealLU<2> {
+public:
+  using Vector = std::array<double, 2>;
+  using Matrix = std::array<Vector, 2>;
+
+  bool decompose(double fac, const Matrix &jac) {
+    const double a = fac - jac[0][0];
+    const double b = -jac[0][1];
+    const double c = -jac[1][0];
+    const double d = fac - jac[1][1];
+    const double det = a * d - b * c;
+    if (det == 0.0) {
+      return false;
+    }
+    const double idet = 1.0 / det;
+    i00 = d * idet;
+    i01 = -b * idet;
+    i10 = -c * idet;
+    i11 = a * idet;
+    return true;
+  }
+
+  void solve(Vector &b) const {
+    const double b0 = b[0];
+    const double b1 = b[1];
+    b[0] = i00 * b0 + i01 * b1;
+    b[1] = i10 * b0 + i11 * b1;
+  }
+
+private:
+  double i00 = 0.0, i01 = 0.0, i10 = 0.0, i11 = 0.0;
+};
+
+/**
+ * @brief LU decomposition with partial pivoting of a complex N x N matrix,
+ * with the real and imaginary parts stored separately.
+ */
+template <size_t N> class SmallComplexLU {
+public:
+  using Vector = std::array<double, N>;
+  using Matrix = std::array<Vector, N>;
+
+  /**
+   * @brief Decompose `(alpha + i beta) * 1 - jac`.
+   * @return False if the matrix is singular.
+   */
+  bool decompose(double alpha, double beta, const Matrix &jac) {
+    for (size_t i = 0; i < N; i++) {
+      for (size_t j = 0; j < N; j++) {
+        ar[i][j] = -jac[i][j];
+        ai[i][j] = 0.0;
+      }
+      ar[i][i] += alpha;
+      ai[i][i] = beta;
+    }
+    for (size_t k = 0; k < N; k++) {
+      size_t m = k;
+      for (size_t i = k + 1; i < N; i++) {
+        if (std::abs(ar[i][k]) + std::abs(ai[i][k]) >
+            std::abs(ar[m][k]) + std::abs(ai[m][k])) {
+          m = i;
+        }
+      }
+      ip[k] = m;
+      if (m != k) {
+        std::swap(ar[m], ar[k]);
+        std::swap(ai[m], ai[k]);
+      }
+      const double den = ar[k][k] * ar[k][k] + ai[k][k] * ai[k][k];
+      if (den == 0.0) {
+        return false;
+      }
+      const double invr = ar[k][k] / den;
+      const double invi = -ai[k][k] / den;
+      for (size_t i = k + 1; i < N; i++) {
+        const double lr = ar[i][k] * invr - ai[i][k] * invi;
+        const double li = ar[i][k] * invi + ai[i][k] * invr;
+        ar[i][k] = lr;
+        ai[i][k] = li;
+        for (size_t j = k + 1; j < N; j++) {
+          ar[i][j] -= lr * ar[k][j] - li * ai[k][j];
+          ai[i][j] -= lr * ai[k][j] + li * ar[k][j];
+        }
+      }
+    }
+    return true;
+  }
+
+  /// Overwrite `br + i bi` with the solution of the decomposed system.
+  void solve(Vector &br, Vector &bi) const {
+    for (size_t k = 0; k < N; k++) {
+      std::swap(br[k], br[ip[k]]);
+      std::swap(bi[k], bi[ip[k]]);
+      for (size_t i = k + 1; i < N; i++) {
+        br[i] -= ar[i][k] * br[k] - ai[i][k] * bi[k];
+        bi[i] -= ar[i][k] * bi[k] + ai[i][k] * br[k];
+      }
+    }
+    for (size_t k = N; k-- > 0;) {
+      double sr = br[k];
+      double si = bi[k];
+      for (size_t j = k + 1; j < N; j++) {
+        sr -= ar[k][j] * br[j] - ai[k][j] * bi[j];
+        si -= ar[k][j] * bi[j] + ai[k][j] * br[j];
+      }
+      const double den = ar[k][k] * ar[k][k] + ai[k][k] * ai[k][k];
+      br[k] = (sr * ar[k][k] + si * ai[k][k]) / den;
+      bi[k] = (si * ar[k][k] - sr * ai[k][k]) / den;
+    }
+  }
+
+private:
+  Matrix ar{};
+  Matrix ai{};
+  std::array<size_t, N> ip{};
+};
+
+/**
+ * @brief Specialization for 2 x 2 matrices storing the explicit inverse.
+ */
+template <> class SmallComplexLU<2> {
+public:
+  using Vector = std::array<double, 2>;
+  using Matrix = std::array<Vector, 2>;
+
+  bool decompose(double alpha, double beta, const Matrix &jac) {
+    // (a b; c d) with a and d complex, b and c real
+    const double ar = alpha - jac[0][0];
+    const double dr = alpha - jac[1][1];
+    const double b = -jac[0][1];
+    const double c = -jac[1][0];
+    // det = a * d - b * c
+    const double detr = ar * dr - beta * beta - b * c;
+    const double deti = beta * (ar + dr);
+    const double den = detr * detr + deti * deti;
+    if (den == 0.0) {
+      return false;
+    }
+    const double idetr = detr / den;
+    const double ideti = -deti / den;
+    i00r = dr * idetr - beta * ideti;
+    i00i = dr * ideti + beta * idetr;
+    i01r = -b * idetr;
+    i01i = -b * ideti;
+    i10r = -c * idetr;
+    i10i = -c * ideti;
+    i11r = ar * idetr - beta * ideti;
+    i11i = ar * ideti + beta * idetr;
+    return true;
+  }
+
+  void solve(Vector &br, Vector &bi) const {
+    const double r0 = br[0], r1 = br[1];
+    const double m0 = bi[0], m1 = bi[1];
+    br[0] = i00r * r0 - i00i * m0 + i01r * r1 - i01i * m1;
+    bi[0] = i00r * m0 + i00i * r0 + i01r * m1 + i01i * r1;
+    br[1] = i10r * r0 - i10i * m0 + i11r * r1 - i11i * m1;
+    bi[1] = i10r * m0 + i10i * r0 + i11r * m1 + i11i * r1;
+  }
+
+private:
+  double i00r = 0.0, i00i = 0.0, i01r = 0.0, i01i = 0.0;
+  double i10r = 0.0, i10i = 0.0, i11r = 0.0, i11i = 0.0;
+};
+
+//===========================================================================
+//---- Fixed-dimension RADAU5 -----------------------------------------------
+//===========================================================================
+
+/**
+ * @brief Three-stage Radau IIA method of order 5 (RADAU5 of Hairer and
+ * Wanner) for systems of fixed dimension `N` with an identity mass matrix
+ * and a full Jacobian.
+ *
+ * This is the algorithm of `radau` with the number of stages fixed to 3.
+ * All storage lives in the object and no heap allocation is performed, and
+ * the linear systems are solved with `SmallRealLU` and `SmallComplexLU`,
+ * which for N = 2 are closed-form. For tiny systems this removes most of the
+ * overhead of the workspace handling and runtime-dimension loops of `radau`.
+ *
+ * The callbacks of `integrate` are:
+ *
+ *   fcn(double x, const Vector &y, Vector &dy)    -- dy = f(x, y)
+ *   jac(double x, const Vector &y, Matrix &dfy)   -- dfy[i][j] = df_i/dy_j
+ *   solout(int nr, double xold, double x, const Vector &y,
+ *          const Radau5 &solver) -> bool
+ *
+ * `solout` is called after every accepted step (nr is the step number,
+ * starting from 1 at the initial point) and may use `dense` to evaluate the
+ * solution on [xold, x]. Returning false stops the integration.
+ */
+template <size_t N> class Radau5 {
+public:
+  using Vector = std::array<double, N>;
+  using Matrix = std::array<Vector, N>;
+
+  // Relative and absolute tolerances
+  double rtol = 1e-6;
+  double atol = 1e-6;
+  // Maximal step size. If zero, the length of the integration interval.
+  double hmax = 0.0;
+  // Maximal number of steps
+  int nmax = 100000;
+  // Maximal number of Newton iterations per step
+  int nit = 7;
+  // If true, start the Newton iterations from zero instead of extrapolating
+  // the collocation polynomial of the previous step.
+  bool startn = false;
+  // If true, use the predictive step-size controller of Gustafsson
+  bool pred = true;
+  // Rounding unit, safety factor for the step size, threshold of the Newton
+  // convergence rate below which the Jacobian is reused, stopping criterion
+  // for the Newton iterations (zero for the default), range of step-size
+  // ratios for which the decomposition is reused and bounds on the step-size
+  // ratio h / hnew.
+  double uround = 1e-16;
+  double safe = 0.9;
+  double thet = 0.001;
+  double fnewt = 0.0;
+  double quot1 = 1.0;
+  double quot2 = 1.2;
+  double facl = 5.0;
+  double facr = 0.125;
+
+  // If true, measure the time spent in each phase of the integration
+  bool timing = false;
+
+  // Statistics of the last integration
+  SolverStats stats;
+
+  /**
+   * @brief Integrate y' = fcn(x, y) from `x` to `xend`.
+   *
+   * @param x Initial value of x. Set to the last x reached.
+   * @param y Initial value of y. Set to the solution at x.
+   * @param h Initial step size. Set to the predicted next step size.
+   * @return 1 if successful, 2 if interrupted by `solout`, -2 if more than
+   * `nmax` steps are needed, -3 if the step size becomes too small and -4 if
+   * the matrix is repeatedly singular.
+   */
+  template <class Fcn, class Jac, class Solout>
+  int integrate(Fcn &&fcn, Jac &&jac, double &x, Vector &y, double xend,
+                double &h, Solout &&solout);
+
+  /// Value of the `i`th component of the collocation polynomial of the last
+  /// accepted step at `x`.
+  double dense(size_t i, double x) const {
+    const double s = (x - xsol) / hsol;
+    return cont[0][i] +
+           s * (cont[1][i] +
+                (s - c2m1) * (cont[2][i] + (s - c1m1) * cont[3][i]));
+  }
+
+  /// Last point reached and size of the last accepted step
+  double get_x() const { return xsol; }
+  double get_h() const { return hsol; }
+
+private:
+  // Nodes and error-estimate weights of the method
+  static constexpr double sq6 = 2.449489742783178098197284;
+  static constexpr double c1 = (4.0 - sq6) / 10.0;
+  static constexpr double c2 = (4.0 + sq6) / 10.0;
+  static constexpr double c1m1 = c1 - 1.0;
+  static constexpr double c2m1 = c2 - 1.0;
+  static constexpr double c1mc2 = c1 - c2;
+  static constexpr double dd1 = -(13.0 + 7.0 * sq6) / 3.0;
+  static constexpr double dd2 = (-13.0 + 7.0 * sq6) / 3.0;
+  static constexpr double dd3 = -1.0 / 3.0;
+  // Eigenvalues of the inverse of the Runge-Kutta matrix (real u1 and
+  // complex alph +- i beta), see `coercv`
+  static constexpr double u1 = 3.637834252744495732208418;
+  static constexpr double alph = 2.681082873627752133895791;
+  static constexpr double beta = 3.050430199247410569426378;
+  // Transformation to the eigenbasis of the Runge-Kutta matrix and back, see
+  // `coertv`
+  static constexpr double t11 = .09123239487089294279155;
+  static constexpr double t12 = -.141255295020954208428;
+  static constexpr double t13 = -.03002919410514742449186;
+  static constexpr double t21 = .2417179327071070189575;
+  static constexpr double t22 = .204129352293799931996;
+  static constexpr double t23 = .3829421127572619377954;
+  static constexpr double t31 = .9660481826150929361906;
+  static constexpr double ti11 = 4.325579890063155351024;
+  static constexpr double ti12 = .3391992518158098695428;
+  static constexpr double ti13 = .5417705399358748711865;
+  static constexpr double ti21 = -4.178718591551904727346;
+  static constexpr double ti22 = -.3276828207610623870825;
+  static constexpr double ti23 = .4766235545005504519601;
+  static constexpr double ti31 = -.5028726349457868759512;
+  static constexpr double ti32 = 2.571926949855605429187;
+  static constexpr double ti33 = -.5960392048282249249688;
+
+  enum class Newton { Converged, Slow, Failed };
+
+  // Current state: derivative at the start of the step, scaling of the
+  // errors, Jacobian and decompositions of the linear systems
+  Vector y0{};
+  Vector scal{};
+  Matrix fjac{};
+  SmallRealLU<N> e1;
+  SmallComplexLU<N> e2;
+  // Stage increments, transformed increments and scratch space
+  Vector z1{}, z2{}, z3{};
+  Vector f1{}, f2{}, f3{};
+  Vector tmp{};
+  // Coefficients of the collocation polynomial of the last accepted step
+  std::array<Vector, 4> cont{};
+  double xsol = 0.0;
+  double hsol = 1.0;
+
+  // Transformed tolerances and Newton controls
+  double rtol1 = 0.0;
+  double atol1 = 0.0;
+  double fnewt1 = 0.0;
+  double faccon = 1.0;
+  double theta = 0.0;
+  int newt = 0;
+
+  // Run `f`, adding the elapsed time to `total` if `timing` is set
+  template <class F> void timed(double &total, F &&f) {
+    if (!timing) {
+      f();
+      return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    total += std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           start)
+                 .count();
+  }
+
+  template <class Fcn>
+  Newton solve_stages(Fcn &fcn, double x, const Vector &y, double &h,
+                      double fac1, double alphn, double betan);
+
+  template <class Fcn>
+  double estimate_error(Fcn &fcn, double x, const Vector &y, double h,
+                        bool first, bool reject);
+};
+
+/**
+ * @brief Solve the collocation equations of the step from x to x + h with
+ * simplified Newton iterations.
+ *
+ * @return `Converged` on success, `Slow` if the iterations converge too
+ * slowly, in which case `h` is reduced, and `Failed` if they diverge.
+ */
+template <size_t N>
+template <class Fcn>
+typename Radau5<N>::Newton
+Radau5<N>::solve_stages(Fcn &fcn, double x, const Vector &y, double &h,
+                        double fac1, double alphn, double betan) {
+  double dynold = 0.0;
+  double thqold = 0.0;
+  newt = 0;
+  faccon = pow(std::max(faccon, uround), 0.8);
+  theta = std::abs(thet);
+  while (true) {
+    if (newt >= nit) {
+      return Newton::Failed;
+    }
+    // Right-hand side at the stages
+    for (size_t i = 0; i < N; i++) {
+      tmp[i] = y[i] + z1[i];
+    }
+    timed(stats.time_fcn,
+          [&] { fcn(x + c1 * h, static_cast<const Vector &>(tmp), z1); });
+    for (size_t i = 0; i < N; i++) {
+      tmp[i] = y[i] + z2[i];
+    }
+    timed(stats.time_fcn,
+          [&] { fcn(x + c2 * h, static_cast<const Vector &>(tmp), z2); });
+    for (size_t i = 0; i < N; i++) {
+      tmp[i] = y[i] + z3[i];
+    }
+    timed(stats.time_fcn,
+          [&] { fcn(x + h, static_cast<const Vector &>(tmp), z3); });
+    stats.nfcn += 3;
+
+    // Transform to the eigenbasis and solve the linear systems
+    for (size_t i = 0; i < N; i++) {
+      const double a1 = z1[i];
+      const double a2 = z2[i];
+      const double a3 = z3[i];
+      const double s2 = -f2[i];
+      const double s3 = -f3[i];
+      z1[i] = ti11 * a1 + ti12 * a2 + ti13 * a3 - f1[i] * fac1;
+      z2[i] = ti21 * a1 + ti22 * a2 + ti23 * a3 + s2 * alphn - s3 * betan;
+      z3[i] = ti31 * a1 + ti32 * a2 + ti33 * a3 + s3 * alphn + s2 * betan;
+    }
+    timed(stats.time_sol, [&] {
+      e1.solve(z1);
+      e2.solve(z2, z3);
+    });
+    ++stats.nsol;
+    ++newt;
+
+    double dyno = 0.0;
+    for (size_t i = 0; i < N; i++) {
+      const double d1 = z1[i] / scal[i];
+      const double d2 = z2[i] / scal[i];
+      const double d3 = z3[i] / scal[i];
+      dyno += d1 * d1 + d2 * d2 + d3 * d3;
+    }
+    dyno = sqrt(dyno / double(3 * N));
+
+    // Bad convergence or number of iterations too large
+    if (newt > 1 && newt < nit) {
+      const double thq = dyno / dynold;
+      theta = newt == 2 ? thq : sqrt(thq * thqold);
+      thqold = thq;
+      if (theta >= 0.99) {
+        return Newton::Failed;
+      }
+      faccon = theta / (1.0 - theta);
+      const double dyth =
+          faccon * dyno * pow(theta, double(nit - 1 - newt)) / fnewt1;
+      if (dyth >= 1.0) {
+        const double qnewt = std::max(1e-4, std::min(20.0, dyth));
+        h *= 0.8 * pow(qnewt, -1.0 / (4.0 + nit - 1 - newt));
+        return Newton::Slow;
+      }
+    }
+    dynold = std::max(dyno, uround);
+    for (size_t i = 0; i < N; i++) {
+      f1[i] += z1[i];
+      f2[i] += z2[i];
+      f3[i] += z3[i];
+      z1[i] = t11 * f1[i] + t12 * f2[i] + t13 * f3[i];
+      z2[i] = t21 * f1[i] + t22 * f2[i] + t23 * f3[i];
+      z3[i] = t31 * f1[i] + f2[i];
+    }
+    if (faccon * dyno <= fnewt1) {
+      return Newton::Converged;
+    }
+  }
+}
+
+/**
+ * @brief Scaled norm of the embedded error estimate of the step from x to
+ * x + h, see `estrad`.
+ */
+template <size_t N>
+template <class Fcn>
+double Radau5<N>::estimate_error(Fcn &fcn, double x, const Vector &y,
+                                 double h, bool first, bool reject) {
+  const double hee1 = dd1 / h;
+  const double hee2 = dd2 / h;
+  const double hee3 = dd3 / h;
+  Vector f{};
+  for (size_t i = 0; i < N; i++) {
+    f[i] = hee1 * z1[i] + hee2 * z2[i] + hee3 * z3[i];
+    tmp[i] = f[i] + y0[i];
+  }
+  timed(stats.time_sol, [&] { e1.solve(tmp); });
+
+  auto norm = [this]() {
+    double err = 0.0;
+    for (size_t i = 0; i < N; i++) {
+      const double e = tmp[i] / scal[i];
+      err += e * e;
+    }
+    return std::max(sqrt(err / double(N)), 1e-10);
+  };
+
+  double err = norm();
+  if (err >= 1.0 && (first || reject)) {
+    Vector fy{};
+    for (size_t i = 0; i < N; i++) {
+      tmp[i] += y[i];
+    }
+    timed(stats.time_fcn,
+          [&] { fcn(x, static_cast<const Vector &>(tmp), fy); });
+    ++stats.nfcn;
+    for (size_t i = 0; i < N; i++) {
+      tmp[i] = fy[i] + f[i];
+    }
+    timed(stats.time_sol, [&] { e1.solve(tmp); });
+    err = norm();
+  }
+  return err;
+}
+
+template <size_t N>
+template <class Fcn, class Jac, class Solout>
+int Radau5<N>::integrate(Fcn &&fcn, Jac &&jac, double &x, Vector &y,
+                         double xend, double &h, Solout &&solout) {
+  stats = SolverStats{};
+
+  // Tolerances are transformed to match the order of the error estimate
+  rtol1 = 0.1 * pow(rtol, 2.0 / 3.0);
+  atol1 = rtol1 * atol / rtol;
+  fnewt1 = fnewt > 0.0
+               ? fnewt
+               : std::max(10.0 * uround / rtol1, std::min(0.03, sqrt(rtol1)));
+
+  const double posneg = std::copysign(1.0, xend - x);
+  const double hmaxn = hmax == 0.0
+                           ? std::abs(xend - x)
+                           : std::min(std::abs(hmax), std::abs(xend - x));
+  if (std::abs(h) <= 10.0 * uround) {
+    h = 1e-6;
+  }
+  h = posneg * std::min(std::abs(h), hmaxn);
+  double hold = h;
+  double hopt = h;
+  bool reject = false;
+  bool first = true;
+  bool last = false;
+  if ((x + h * 1.0001 - xend) * posneg >= 0.0) {
+    h = xend - x;
+    last = true;
+  }
+  faccon = 1.0;
+  theta = 0.0;
+  const double cfac = safe * double(1 + 2 * nit);
+  int nsing = 0;
+  double hacc = 0.0;
+  double erracc = 0.0;
+
+  for (size_t i = 0; i < N; i++) {
+    scal[i] = atol1 + rtol1 * std::abs(y[i]);
+    cont[0][i] = y[i];
+    cont[1][i] = cont[2][i] = cont[3][i] = 0.0;
+  }
+  xsol = x;
+  hsol = hold;
+  if (!solout(stats.naccpt + 1, x, x, static_cast<const Vector &>(y),
+              static_cast<const Radau5 &>(*this))) {
+    return 2;
+  }
+  timed(stats.time_fcn, [&] { fcn(x, static_cast<const Vector &>(y), y0); });
+  ++stats.nfcn;
+
+  // What must be recomputed before the next step
+  enum class Next { Jacobian, Decomposition, Step };
+  Next next = Next::Jacobian;
+  bool caljac = false;
+  double fac1 = 0.0, alphn = 0.0, betan = 0.0;
+
+  while (true) {
+    if (next == Next::Jacobian) {
+      timed(stats.time_jac,
+            [&] { jac(x, static_cast<const Vector &>(y), fjac); });
+      ++stats.njac;
+      caljac = true;
+    }
+
+    // Unexpected step rejection: halve the step size
+    auto retry = [&]() {
+      h *= 0.5;
+      reject = true;
+      last = false;
+      next = caljac ? Next::Decomposition : Next::Jacobian;
+    };
+
+    if (next != Next::Step) {
+      fac1 = u1 / h;
+      alphn = alph / h;
+      betan = beta / h;
+      bool ok = false;
+      timed(stats.time_dec, [&] {
+        ok = e1.decompose(fac1, fjac) && e2.decompose(alphn, betan, fjac);
+      });
+      ++stats.ndec;
+      if (!ok) {
+        if (++nsing >= 5) {
+          std::cerr << "Encountered repeatedly singular matrix\n";
+          return -4;
+        }
+        retry();
+        continue;
+      }
+    }
+
+    ++stats.nstep;
+    if (stats.nstep > nmax) {
+      std::cerr << "More than " << nmax << " steps needed\n";
+      return -2;
+    }
+    if (0.1 * std::abs(h) <= std::abs(x) * uround) {
+      std::cerr << "Step-size too small: h = " << h << "\n";
+      return -3;
+    }
+    const double xph = x + h;
+
+    // Starting values for the Newton iterations
+    if (first || startn) {
+      z1.fill(0.0);
+      z2.fill(0.0);
+      z3.fill(0.0);
+      f1.fill(0.0);
+      f2.fill(0.0);
+      f3.fill(0.0);
+    } else {
+      const double c3q = h / hold;
+      const double c1q = c1 * c3q;
+      const double c2q = c2 * c3q;
+      for (size_t i = 0; i < N; i++) {
+        const double ak1 = cont[1][i];
+        const double ak2 = cont[2][i];
+        const double ak3 = cont[3][i];
+        const double z1i =
+            c1q * (ak1 + (c1q - c2m1) * (ak2 + (c1q - c1m1) * ak3));
+        const double z2i =
+            c2q * (ak1 + (c2q - c2m1) * (ak2 + (c2q - c1m1) * ak3));
+        const double z3i =
+            c3q * (ak1 + (c3q - c2m1) * (ak2 + (c3q - c1m1) * ak3));
+        z1[i] = z1i;
+        z2[i] = z2i;
+        z3[i] = z3i;
+        f1[i] = ti11 * z1i + ti12 * z2i + ti13 * z3i;
+        f2[i] = ti21 * z1i + ti22 * z2i + ti23 * z3i;
+        f3[i] = ti31 * z1i + ti32 * z2i + ti33 * z3i;
+      }
+    }
+
+    const Newton status = solve_stages(fcn, x, y, h, fac1, alphn, betan);
+    if (status == Newton::Failed) {
+      retry();
+      continue;
+    }
+    if (status == Newton::Slow) {
+      reject = true;
+      last = false;
+      next = caljac ? Next::Decomposition : Next::Jacobian;
+      continue;
+    }
+
+    // Error estimation and new step size. We require 0.2 <= hnew / h <= 8.
+    const double err = estimate_error(fcn, x, y, h, first, reject);
+    const double fac = std::min(safe, cfac / double(newt + 2 * nit));
+    double quot = std::max(facr, std::min(facl, pow(err, 0.25) / fac));
+    double hnew = h / quot;
+
+    if (!(err < 1.0)) {
+      // Step is rejected
+      reject = true;
+      last = false;
+      if (first) {
+        h *= 0.1;
+      } else {
+        h = hnew;
+      }
+      if (stats.naccpt >= 1) {
+        ++stats.nrejct;
+      }
+      next = caljac ? Next::Decomposition : Next::Jacobian;
+      continue;
+    }
+
+    // Step is accepted
+    first = false;
+    ++stats.naccpt;
+    if (pred) {
+      // Predictive controller of Gustafsson
+      if (stats.naccpt > 1) {
+        double facgus = (hacc / h) * pow(err * err / erracc, 0.25) / safe;
+        facgus = std::max(facr, std::min(facl, facgus));
+        quot = std::max(quot, facgus);
+        hnew = h / quot;
+      }
+      hacc = h;
+      erracc = std::max(1e-2, err);
+    }
+    const double xold = x;
+    hold = h;
+    x = xph;
+    for (size_t i = 0; i < N; i++) {
+      y[i] += z3[i];
+      const double ak = (z1[i] - z2[i]) / c1mc2;
+      const double acont3 = (ak - z1[i] / c1) / c2;
+      cont[0][i] = y[i];
+      cont[1][i] = (z2[i] - z3[i]) / c2m1;
+      cont[2][i] = (ak - cont[1][i]) / c1m1;
+      cont[3][i] = cont[2][i] - acont3;
+      scal[i] = atol1 + rtol1 * std::abs(y[i]);
+    }
+    xsol = x;
+    hsol = hold;
+    if (!solout(stats.naccpt + 1, xold, x, static_cast<const Vector &>(y),
+                static_cast<const Radau5 &>(*this))) {
+      return 2;
+    }
+    caljac = false;
+    if (last) {
+      h = hopt;
+      return 1;
+    }
+    timed(stats.time_fcn,
+          [&] { fcn(x, static_cast<const Vector &>(y), y0); });
+    ++stats.nfcn;
+    hnew = posneg * std::min(std::abs(hnew), hmaxn);
+    hopt = std::min(h, hnew);
+    if (reject) {
+      hnew = posneg * std::min(std::abs(hnew), std::abs(h));
+    }
+    reject = false;
+    if ((x + hnew / quot1 - xend) * posneg >= 0.0) {
+      h = xend - x;
+      last = true;
+    } else {
+      const double qt = hnew / h;
+      if (theta <= thet && qt >= quot1 && qt <= quot2) {
+        next = Next::Step;
+        continue;
+      }
+      h = hnew;
+    }
+    next = theta <= thet ? Next::Decomposition : Next::Jacobian;
+  }
+}
+
+} // namespace stiff
+
+#endif // STIFF_RADAU5_HPP
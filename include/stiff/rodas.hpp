@@ -0,0 +1,414 @@
+#ifndef STIFF_RODAS_HPP
+#define STIFF_RODAS_HPP
+
+#include "stiff/common.hpp"
+#include "stiff/radau5.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+namespace stiff {
+
+//===========================================================================
+//---- Rosenbrock method RODAS for small dense systems ----------------------
+//===========================================================================
+
+/// Coefficients of the stiffly accurate Rosenbrock method RODAS of order
+/// 4(3), in the transformed form of Hairer & Wanner's RODAS.
+struct RodasCoefficients {
+  static constexpr double gamma = 0.25;
+  static constexpr double c2 = 0.386;
+  static constexpr double c3 = 0.21;
+  static constexpr double c4 = 0.63;
+  static constexpr double d1 = 0.25;
+  static constexpr double d2 = -0.1043;
+  static constexpr double d3 = 0.1035;
+  static constexpr double d4 = -0.3620000000000023e-1;
+  static constexpr double a21 = 0.1544000000000000e+1;
+  static constexpr double a31 = 0.9466785280815826;
+  static constexpr double a32 = 0.2557011698983284;
+  static constexpr double a41 = 0.3314825187068521e+1;
+  static constexpr double a42 = 0.2896124015972201e+1;
+  static constexpr double a43 = 0.9986419139977817;
+  static constexpr double a51 = 0.1221224509226641e+1;
+  static constexpr double a52 = 0.6019134481288629e+1;
+  static constexpr double a53 = 0.1253708332932087e+2;
+  static constexpr double a54 = -0.6878860361058950;
+  static constexpr double c21 = -0.5668800000000000e+1;
+  static constexpr double c31 = -0.2430093356833875e+1;
+  static constexpr double c32 = -0.2063599157091915;
+  static constexpr double c41 = -0.1073529058151375;
+  static constexpr double c42 = -0.9594562251023355e+1;
+  static constexpr double c43 = -0.2047028614809616e+2;
+  static constexpr double c51 = 0.7496443313967647e+1;
+  static constexpr double c52 = -0.1024680431464352e+2;
+  static constexpr double c53 = -0.3399990352819905e+2;
+  static constexpr double c54 = 0.1170890893206160e+2;
+  static constexpr double c61 = 0.8083246795921522e+1;
+  static constexpr double c62 = -0.7981132988064893e+1;
+  static constexpr double c63 = -0.3152159432874371e+2;
+  static constexpr double c64 = 0.1631930543123136e+2;
+  static constexpr double c65 = -0.6058818238834054e+1;
+};
+
+/**
+ * @brief Linearly implicit Rosenbrock integrator (RODAS, order 4 with an
+ * embedded order 3 error estimate) for stiff systems of fixed dimension N.
+ *
+ * Each step needs one Jacobian, one LU decomposition of 1 / (gamma h) - J and
+ * six solves with it, but no Newton iteration, which makes it cheaper than
+ * `Radau5` for small systems with an exact Jacobian. The Jacobian must be
+ * exact for the order to hold. The callbacks and return codes are those of
+ * `Radau5::integrate`:
+ *
+ *   fcn(double x, const Vector &y, Vector &dy)
+ *   jac(double x, const Vector &y, Matrix &dfy)
+ *   solout(int nr, double xold, double x, const Vector &y,
+ *          const Rodas &solver) -> bool
+ *
+ * Unless `autonomous` is set, df/dx is computed by a forward difference at
+ * the start of each step, at the cost of one more RHS evaluation. The dense
+ * output is the cubic Hermite interpolant of the step.
+ */
+template <size_t N> class Rodas : private RodasCoefficients {
+public:
+  using Vector = std::array<double, N>;
+  using Matrix = std::array<Vector, N>;
+
+  // Relative and absolute tolerances
+  double rtol = 1e-6;
+  double atol = 1e-6;
+  // Maximal step size. If zero, the length of the integration interval.
+  double hmax = 0.0;
+  // Maximal number of steps
+  int nmax = 100000;
+  // If true, the RHS does not depend on x explicitly
+  bool autonomous = false;
+  // If true, use the predictive step-size controller of Gustafsson
+  bool pred = true;
+  // Rounding unit, safety factor for the step size and bounds on the
+  // step-size ratio h / hnew.
+  double uround = 1e-16;
+  double safe = 0.9;
+  double facl = 5.0;
+  double facr = 1.0 / 6.0;
+
+  // If true, measure the time spent in each phase of the integration
+  bool timing = false;
+
+  // Statistics of the last integration
+  SolverStats stats;
+
+  /**
+   * @brief Integrate y' = fcn(x, y) from `x` to `xend`.
+   *
+   * @param x Initial value of x. Set to the last x reached.
+   * @param y Initial value of y. Set to the solution at x.
+   * @param h Initial step size. Set to the predicted next step size.
+   * @return 1 if successful, 2 if interrupted by `solout`, -2 if more than
+   * `nmax` steps are needed, -3 if the step size becomes too small and -4 if
+   * the matrix is repeatedly singular.
+   */
+  template <class Fcn, class Jac, class Solout>
+  int integrate(Fcn &&fcn, Jac &&jac, double &x, Vector &y, double xend,
+                double &h, Solout &&solout);
+
+  /// Value of the `i`th component of the interpolant of the last accepted
+  /// step at `x`.
+  double dense(size_t i, double x) const {
+    const double t = 1.0 + (x - xsol) / hsol;
+    return cont[0][i] +
+           t * (cont[1][i] + (1.0 - t) * (cont[2][i] + t * cont[3][i]));
+  }
+
+  /// Last point reached and size of the last accepted step
+  double get_x() const { return xsol; }
+  double get_h() const { return hsol; }
+
+private:
+  // Derivatives at the start of the step, Jacobian and decomposition
+  Vector dy0{};
+  Vector fx{};
+  Matrix fjac{};
+  SmallRealLU<N> lu;
+  // Stages and scratch space
+  std::array<Vector, 6> k{};
+  Vector u{};
+  Vector f{};
+  // Coefficients of the interpolant of the last accepted step
+  std::array<Vector, 4> cont{};
+  double xsol = 0.0;
+  double hsol = 1.0;
+
+  // Run `f`, adding the elapsed time to `total` if `timing` is set
+  template <class F> void timed(double &total, F &&f) {
+    if (!timing) {
+      f();
+      return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    total += std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           start)
+                 .count();
+  }
+
+  template <class Fcn>
+  void compute_stages(Fcn &fcn, double x, const Vector &y, double h);
+};
+
+/**
+ * @brief Compute the six stages of the step from x to x + h. On return `u`
+ * holds the embedded solution, and the new solution is `u + k[5]`.
+ */
+template <size_t N>
+template <class Fcn>
+void Rodas<N>::compute_stages(Fcn &fcn, double x, const Vector &y,
+                              double h) {
+  const double hd1 = h * d1;
+  const double hd2 = h * d2;
+  const double hd3 = h * d3;
+  const double hd4 = h * d4;
+  const double hinv = 1.0 / h;
+  auto rhs = [&](double xs) {
+    timed(stats.time_fcn,
+          [&] { fcn(xs, static_cast<const Vector &>(u), f); });
+    ++stats.nfcn;
+  };
+  auto solve = [&](Vector &b) {
+    timed(stats.time_sol, [&] { lu.solve(b); });
+    ++stats.nsol;
+  };
+
+  for (size_t i = 0; i < N; i++) {
+    k[0][i] = dy0[i] + hd1 * fx[i];
+  }
+  solve(k[0]);
+
+  for (size_t i = 0; i < N; i++) {
+    u[i] = y[i] + a21 * k[0][i];
+  }
+  rhs(x + c2 * h);
+  for (size_t i = 0; i < N; i++) {
+    k[1][i] = f[i] + hd2 * fx[i] + hinv * c21 * k[0][i];
+  }
+  solve(k[1]);
+
+  for (size_t i = 0; i < N; i++) {
+    u[i] = y[i] + a31 * k[0][i] + a32 * k[1][i];
+  }
+  rhs(x + c3 * h);
+  for (size_t i = 0; i < N; i++) {
+    k[2][i] = f[i] + hd3 * fx[i] + hinv * (c31 * k[0][i] + c32 * k[1][i]);
+  }
+  solve(k[2]);
+
+  for (size_t i = 0; i < N; i++) {
+    u[i] = y[i] + a41 * k[0][i] + a42 * k[1][i] + a43 * k[2][i];
+  }
+  rhs(x + c4 * h);
+  for (size_t i = 0; i < N; i++) {
+    k[3][i] = f[i] + hd4 * fx[i] +
+              hinv * (c41 * k[0][i] + c42 * k[1][i] + c43 * k[2][i]);
+  }
+  solve(k[3]);
+
+  for (size_t i = 0; i < N; i++) {
+    u[i] = y[i] + a51 * k[0][i] + a52 * k[1][i] + a53 * k[2][i] +
+           a54 * k[3][i];
+  }
+  rhs(x + h);
+  for (size_t i = 0; i < N; i++) {
+    k[4][i] = f[i] + hinv * (c51 * k[0][i] + c52 * k[1][i] + c53 * k[2][i] +
+                             c54 * k[3][i]);
+  }
+  solve(k[4]);
+
+  // Embedded solution
+  for (size_t i = 0; i < N; i++) {
+    u[i] += k[4][i];
+  }
+  rhs(x + h);
+  for (size_t i = 0; i < N; i++) {
+    k[5][i] = f[i] + hinv * (c61 * k[0][i] + c62 * k[1][i] + c63 * k[2][i] +
+                             c64 * k[3][i] + c65 * k[4][i]);
+  }
+  solve(k[5]);
+}
+
+template <size_t N>
+template <class Fcn, class Jac, class Solout>
+int Rodas<N>::integrate(Fcn &&fcn, Jac &&jac, double &x, Vector &y,
+                        double xend, double &h, Solout &&solout) {
+  stats = SolverStats{};
+
+  const double posneg = std::copysign(1.0, xend - x);
+  const double hmaxn = hmax == 0.0
+                           ? std::abs(xend - x)
+                           : std::min(std::abs(hmax), std::abs(xend - x));
+  if (std::abs(h) <= 10.0 * uround) {
+    h = 1e-6;
+  }
+  h = posneg * std::min(std::abs(h), hmaxn);
+  double hopt = h;
+  bool reject = false;
+  bool first = true;
+  bool last = false;
+  if ((x + h * 1.0001 - xend) * posneg >= 0.0) {
+    h = xend - x;
+    last = true;
+  }
+  int nsing = 0;
+  double hacc = 0.0;
+  double erracc = 0.0;
+
+  for (size_t i = 0; i < N; i++) {
+    cont[0][i] = y[i];
+    cont[1][i] = cont[2][i] = cont[3][i] = 0.0;
+  }
+  xsol = x;
+  hsol = h;
+  if (!solout(stats.naccpt + 1, x, x, static_cast<const Vector &>(y),
+              static_cast<const Rodas &>(*this))) {
+    return 2;
+  }
+  timed(stats.time_fcn, [&] { fcn(x, static_cast<const Vector &>(y), dy0); });
+  ++stats.nfcn;
+
+  // The Jacobian and df/dx are only recomputed after an accepted step
+  bool caljac = true;
+  while (true) {
+    if (caljac) {
+      timed(stats.time_jac,
+            [&] { jac(x, static_cast<const Vector &>(y), fjac); });
+      ++stats.njac;
+      if (autonomous) {
+        fx.fill(0.0);
+      } else {
+        const double delt = sqrt(uround * std::max(1e-5, std::abs(x)));
+        timed(stats.time_fcn,
+              [&] { fcn(x + delt, static_cast<const Vector &>(y), f); });
+        ++stats.nfcn;
+        for (size_t i = 0; i < N; i++) {
+          fx[i] = (f[i] - dy0[i]) / delt;
+        }
+      }
+      caljac = false;
+    }
+
+    bool ok = false;
+    timed(stats.time_dec, [&] { ok = lu.decompose(1.0 / (h * gamma), fjac); });
+    ++stats.ndec;
+    if (!ok) {
+      if (++nsing >= 5) {
+        std::cerr << "Encountered repeatedly singular matrix\n";
+        return -4;
+      }
+      h *= 0.5;
+      reject = true;
+      last = false;
+      continue;
+    }
+
+    ++stats.nstep;
+    if (stats.nstep > nmax) {
+      std::cerr << "More than " << nmax << " steps needed\n";
+      return -2;
+    }
+    if (0.1 * std::abs(h) <= std::abs(x) * uround) {
+      std::cerr << "Step-size too small: h = " << h << "\n";
+      return -3;
+    }
+
+    compute_stages(fcn, x, y, h);
+
+    // Error estimation and new step size
+    double err = 0.0;
+    for (size_t i = 0; i < N; i++) {
+      const double ynew = u[i] + k[5][i];
+      const double sk =
+          atol + rtol * std::max(std::abs(y[i]), std::abs(ynew));
+      err += (k[5][i] / sk) * (k[5][i] / sk);
+    }
+    err = sqrt(err / double(N));
+    double quot = std::max(facr, std::min(facl, pow(err, 0.25) / safe));
+    double hnew = h / quot;
+
+    if (!(err < 1.0)) {
+      // Step is rejected
+      reject = true;
+      last = false;
+      if (first) {
+        h *= 0.1;
+      } else {
+        h = hnew;
+      }
+      if (stats.naccpt >= 1) {
+        ++stats.nrejct;
+      }
+      continue;
+    }
+
+    // Step is accepted
+    first = false;
+    ++stats.naccpt;
+    if (pred) {
+      // Predictive controller of Gustafsson
+      if (stats.naccpt > 1) {
+        double facgus = (hacc / h) * pow(err * err / erracc, 0.25) / safe;
+        facgus = std::max(facr, std::min(facl, facgus));
+        quot = std::max(quot, facgus);
+        hnew = h / quot;
+      }
+      hacc = h;
+      erracc = std::max(1e-2, err);
+    }
+    const double xold = x;
+    x += h;
+    for (size_t i = 0; i < N; i++) {
+      cont[0][i] = y[i];
+      cont[1][i] = h * dy0[i];
+      y[i] = u[i] + k[5][i];
+    }
+    timed(stats.time_fcn,
+          [&] { fcn(x, static_cast<const Vector &>(y), dy0); });
+    ++stats.nfcn;
+    for (size_t i = 0; i < N; i++) {
+      const double ydiff = y[i] - cont[0][i];
+      const double bspl = cont[1][i] - ydiff;
+      cont[1][i] = ydiff;
+      cont[2][i] = bspl;
+      cont[3][i] = ydiff - h * dy0[i] - bspl;
+    }
+    xsol = x;
+    hsol = h;
+    if (!solout(stats.naccpt + 1, xold, x, static_cast<const Vector &>(y),
+                static_cast<const Rodas &>(*this))) {
+      return 2;
+    }
+    if (last) {
+      h = hopt;
+      return 1;
+    }
+    caljac = true;
+    hnew = posneg * std::min(std::abs(hnew), hmaxn);
+    hopt = std::min(h, hnew);
+    if (reject) {
+      hnew = posneg * std::min(std::abs(hnew), std::abs(h));
+    }
+    reject = false;
+    if ((x + hnew * 1.0001 - xend) * posneg >= 0.0) {
+      h = xend - x;
+      last = true;
+    } else {
+      h = hnew;
+    }
+  }
+}
+
+} // namespace stiff
+
+#endif // STIFF_RODAS_HPP
@@ -8,6 +8,11 @@
 #include "stiff/common.hpp"
 #include "stiff/dc_decsol.hpp"
 #include "stiff/decsol.hpp"
+#include "stiff/dopri5.hpp"
+#include "stiff/dual.hpp"
+#include "stiff/events.hpp"
 #include "stiff/radau.hpp"
+#include "stiff/radau5.hpp"
+#include "stiff/rodas.hpp"
 
 #endif // STIFF_STIFF_HPP
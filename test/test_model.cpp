@@ -2,13 +2,19 @@
 // Created by logan on 8/9/20.
 //
 
+#include <algorithm>
+#include <boost/math/quadrature/gauss_kronrod.hpp>
 #include <darksun/darksun.hpp>
 #include <darksun/standard_model.hpp>
 #include <filesystem>
 #include <fmt/core.h>
 #include <fstream>
 #include <gsl/gsl_errno.h>
+#include <gsl/gsl_sf_bessel.h>
+#include <gsl/gsl_spline.h>
 #include <gtest/gtest.h>
+#include <limits>
+#include <vector>
 
 using namespace darksun;
 
@@ -82,6 +88,83 @@ TEST(TestModel, TestEquilibrium) {
   fmt::print("yeqd = {}, weq_d = {}\n\n", yeq_d, weq_d);
 }
 
+TEST(TestModel, TestThermalSums) {
+  // The recurrence against the Bessel functions evaluated one by one
+  for (double x : {1e-3, 0.1, 1.0, 5.0, 30.0, 300.0}) {
+    const auto sums = thermal_sums(x, ETA_THERMAL_TERMS);
+    double k2 = 0.0;
+    double k3 = 0.0;
+    double g = 0.0;
+    for (int k = 0; k < ETA_THERMAL_TERMS; k++) {
+      const double j = 1.0 + k;
+      const double ek = exp(-k * x);
+      k2 += ek * gsl_sf_bessel_Kn_scaled(2, j * x) / j;
+      k3 += ek * gsl_sf_bessel_Kn_scaled(3, j * x) / j;
+      g += ek *
+           (j * x * gsl_sf_bessel_K1_scaled(j * x) +
+            3.0 * gsl_sf_bessel_Kn_scaled(2, j * x)) /
+           (j * j);
+    }
+    ASSERT_NEAR(sums.k2 / k2, 1.0, 1e-12);
+    ASSERT_NEAR(sums.k3 / k3, 1.0, 1e-12);
+    ASSERT_NEAR(sums.g / g, 1.0, 1e-12);
+  }
+
+  // The quantities computed in one pass against their own functions
+  DarkSunParameters params{10, 1e-1};
+  for (double tsm : {1e-1, 1e-2, 1e-3}) {
+    const double xi = 0.5;
+    const auto thermo = dark_thermodynamics(tsm, xi, params);
+    ASSERT_DOUBLE_EQ(thermo.heff, dark_heff(xi * tsm, params));
+    ASSERT_DOUBLE_EQ(thermo.geff, dark_geff(xi * tsm, params));
+    ASSERT_DOUBLE_EQ(thermo.weq_eta, weq_eta(tsm, xi, params));
+    ASSERT_DOUBLE_EQ(sqrt_gstar(tsm, xi, thermo),
+                     sqrt_gstar(tsm, xi, params));
+  }
+}
+
+TEST(TestModel, TestBesselK) {
+  // The Chebyshev expansions against GSL, across the switch at z = 2
+  std::vector<double> zs;
+  for (double logz = -3.0; logz <= 7.0; logz += 0.01) {
+    zs.push_back(pow(10.0, logz));
+  }
+  std::vector<double> k1(zs.size());
+  std::vector<double> k2(zs.size());
+  bessel_k1_scaled(zs.data(), k1.data(), zs.size());
+  bessel_k2_scaled(zs.data(), k2.data(), zs.size());
+  for (size_t i = 0; i < zs.size(); i++) {
+    ASSERT_NEAR(k1[i] / gsl_sf_bessel_K1_scaled(zs[i]), 1.0, 1e-14);
+    ASSERT_NEAR(k2[i] / gsl_sf_bessel_Kn_scaled(2, zs[i]), 1.0, 1e-14);
+    // The blocks mix both regions and end with a partial block
+    const auto k01 = bessel_k01_scaled(zs[i]);
+    ASSERT_NEAR(k1[i] / k01.k1, 1.0, 4e-16);
+    ASSERT_NEAR(k2[i] / (k01.k0 + 2.0 / zs[i] * k01.k1), 1.0, 4e-16);
+  }
+}
+
+TEST(TestModel, TestBatchGaussKronrod) {
+  // Same rule and refinement as boost's adaptive Gauss-Kronrod
+  using boost::math::quadrature::gauss_kronrod;
+  using Nodes = BatchGaussKronrod15::Nodes;
+  auto f = [](double z) { return z * z * exp(-3.0 * z) / (1.0 + z); };
+  auto fb = [&f](const Nodes &z, Nodes &fz) {
+    for (size_t i = 0; i < z.size(); i++) {
+      fz[i] = f(z[i]);
+    }
+  };
+  const double inf = std::numeric_limits<double>::infinity();
+  for (double a : {0.0, 2.0}) {
+    for (double b : {a + 0.5, a + 10.0, inf}) {
+      const double expected =
+          gauss_kronrod<double, 15>::integrate(f, a, b, 15, 1e-10);
+      const double result =
+          BatchGaussKronrod15::integrate(fb, a, b, 15, 1e-10);
+      ASSERT_NEAR(result / expected, 1.0, 1e-14);
+    }
+  }
+}
+
 TEST(TestModel, TestSigma24) {
   DarkSunParameters params{10, 1e-1};
   fmt::print("sigma_24(cme=1GeV) = {}\n",
@@ -113,10 +196,328 @@ TEST(TestModel, TestSigmav) {
 TEST(TestModel, TestSolveBoltzmann) {
   DarkSunParameters params{10, 1e-1};
 
+  // Sample the solution on a uniform grid up to the CMB. The points before
+  // the start of the integration are skipped.
+  const double final = log(m_eta(params) / T_CMB);
+  params.output = SolutionOutput::Grid;
+  for (size_t i = 0; i < 100; i++) {
+    params.output_logx.push_back(final * double(i) / 99.0);
+  }
   solve_boltzmann(1e-9, 1e-9, params);
 
+  ASSERT_FALSE(params.ts.empty());
+  ASSERT_DOUBLE_EQ(params.ts.back(), final);
+  ASSERT_DOUBLE_EQ(params.ys.back()[0], log(params.rd_eta * RHO_CRIT /
+                                            (m_eta(params) * S_TODAY)));
   for (size_t i = 0; i < params.ts.size(); i++) {
     fmt::print("logx = {}, weta = {}, ydel = {}\n", params.ts[i],
                params.ys[i][0], params.ys[i][1]);
   }
 }
+
+TEST(TestModel, TestSolveBoltzmannRodas) {
+  // Both integrators must agree on the relic densities
+  DarkSunParameters radau{30, 1e-6};
+  DarkSunParameters rodas{30, 1e-6};
+  rodas.solver = BoltzmannSolver::Rodas;
+  solve_boltzmann(1e-7, 1e-7, radau);
+  solve_boltzmann(1e-7, 1e-7, rodas);
+  ASSERT_NEAR(rodas.rd_eta / radau.rd_eta, 1.0, 1e-3);
+  ASSERT_NEAR(rodas.rd_del / radau.rd_del, 1.0, 1e-3);
+  // Freeze-out is located on the dense output, independently of the steps
+  ASSERT_NEAR(rodas.xi_fo / radau.xi_fo, 1.0, 1e-5);
+}
+
+TEST(TestModel, TestSolveBoltzmannStiffnessSwitching) {
+  // Handing over to DOPRI5 after freeze-out must not change the results
+  DarkSunParameters implicit{30, 1e-6};
+  DarkSunParameters switching{30, 1e-6};
+  switching.stiffness_switching = true;
+  std::vector<double> grid;
+  for (size_t i = 0; i <= 200; i++) {
+    grid.push_back(0.25 * double(i));
+  }
+  for (auto *params : {&implicit, &switching}) {
+    params->output = SolutionOutput::Grid;
+    params->output_logx = grid;
+  }
+  solve_boltzmann(1e-7, 1e-7, implicit);
+  solve_boltzmann(1e-7, 1e-7, switching);
+  ASSERT_NEAR(switching.rd_eta / implicit.rd_eta, 1.0, 1e-5);
+  ASSERT_NEAR(switching.rd_del / implicit.rd_del, 1.0, 1e-5);
+  ASSERT_EQ(switching.xi_fo, implicit.xi_fo);
+  ASSERT_LT(switching.solver_stats.nfcn, implicit.solver_stats.nfcn);
+  // The sampled solution continues across the hand-off
+  ASSERT_EQ(switching.ts, implicit.ts);
+  for (size_t i = 0; i < switching.ts.size(); i++) {
+    ASSERT_NEAR(switching.ys[i][0], implicit.ys[i][0], 1e-4);
+  }
+}
+
+TEST(TestModel, TestSolutionOutput) {
+  // Endpoints and the streamed steps against the default of no output
+  DarkSunParameters none{10, 1e-1};
+  DarkSunParameters endpoints{10, 1e-1};
+  DarkSunParameters callback{10, 1e-1};
+  callback.stiffness_switching = true;
+  endpoints.output = SolutionOutput::Endpoints;
+  callback.output = SolutionOutput::Callback;
+  std::vector<double> steps;
+  callback.output_callback = [&](double logx, const std::array<double, 2> &) {
+    steps.push_back(logx);
+  };
+  solve_boltzmann(1e-7, 1e-7, none);
+  solve_boltzmann(1e-7, 1e-7, endpoints);
+  solve_boltzmann(1e-7, 1e-7, callback);
+
+  ASSERT_TRUE(none.ts.empty());
+  ASSERT_EQ(endpoints.rd_eta, none.rd_eta);
+  ASSERT_EQ(endpoints.ts.size(), endpoints.ys.size());
+  ASSERT_EQ(endpoints.ts.size(), 2);
+  ASSERT_DOUBLE_EQ(endpoints.ts.back(), log(m_eta(none) / T_CMB));
+  ASSERT_TRUE(callback.ts.empty());
+  // One call per accepted step of all integrators, plus the initial state
+  ASSERT_EQ(steps.size(), callback.solver_stats.naccpt + 1);
+  ASSERT_TRUE(std::is_sorted(steps.begin(), steps.end()));
+  ASSERT_EQ(steps.front(), endpoints.ts.front());
+  ASSERT_DOUBLE_EQ(steps.back(), endpoints.ts.back());
+}
+
+TEST(TestModel, TestEstimateBoltzmann) {
+  // The sudden freeze-out estimate should be within a few tens of percent of
+  // the full solution
+  for (double lam : {1e-5, 1e-1}) {
+    DarkSunParameters estimate{7, lam};
+    DarkSunParameters full{7, lam};
+    estimate_boltzmann(estimate);
+    solve_boltzmann(1e-7, 1e-7, full);
+    ASSERT_NEAR(estimate.rd_eta / full.rd_eta, 1.0, 0.3);
+    ASSERT_NEAR(estimate.rd_del / full.rd_del, 1.0, 0.3);
+    ASSERT_NEAR(estimate.tsm_fo / full.tsm_fo, 1.0, 0.2);
+    ASSERT_EQ(estimate.solver_stats.naccpt, 0);
+  }
+}
+
+TEST(TestModel, TestBoltzmannJacobian) {
+  // The Jacobian from automatic differentiation against central differences
+  DarkSunParameters params{10, 1e-1};
+  double start;
+  double final;
+  BoltzmannVector y;
+  setup_boltzmann(params, start, final, y);
+  const double logx = start + 1.0;
+
+  BoltzmannMatrix dfy;
+  boltzmann_jac(logx, y, dfy, params);
+  for (size_t j = 0; j < 2; j++) {
+    const double dy = 1e-6 * std::max(1.0, std::abs(y[j]));
+    BoltzmannVector yp = y;
+    BoltzmannVector ym = y;
+    yp[j] += dy;
+    ym[j] -= dy;
+    BoltzmannVector fp;
+    BoltzmannVector fm;
+    boltzmann(logx, yp, fp, params);
+    boltzmann(logx, ym, fm, params);
+    for (size_t i = 0; i < 2; i++) {
+      const double fd = (fp[i] - fm[i]) / (2.0 * dy);
+      ASSERT_NEAR(dfy[i][j], fd, 1e-6 * std::abs(fd) + 1e-12);
+    }
+  }
+}
+
+TEST(TestModel, TestXiTable) {
+  DarkSunParameters params{10, 1e-1};
+
+  const double tsm_min = 1e-6;
+  const double tsm_max = 1e2;
+  ASSERT_TRUE(tabulate_xi_const_tsm(tsm_min, tsm_max, params));
+
+  constexpr size_t num_ts = 97;
+  const double logt_stp = log(tsm_max / tsm_min) / double(num_ts - 1);
+  for (size_t i = 0; i < num_ts; i++) {
+    const double tsm = tsm_min * exp(double(i) * logt_stp);
+    const double xi_table = compute_xi_const_tsm(tsm, params);
+    const double xi_exact = solve_xi_const_tsm(tsm, params);
+    ASSERT_LE(std::abs(xi_table - xi_exact), 1e-6 * xi_exact + 1e-8);
+  }
+
+  // A table covering the range is reused for the same model only
+  const gsl_spline *spline = params.xi_spline;
+  ASSERT_TRUE(tabulate_xi_const_tsm(1e-4, 1.0, params));
+  ASSERT_EQ(params.xi_spline, spline);
+  params.xi_inf = 2e-2;
+  ASSERT_TRUE(tabulate_xi_const_tsm(1e-4, 1.0, params));
+  ASSERT_LE(params.xi_log_tsm_max, log(1.0) + 0.1);
+  const double xi_table = compute_xi_const_tsm(1e-2, params);
+  const double xi_exact = solve_xi_const_tsm(1e-2, params);
+  ASSERT_LE(std::abs(xi_table - xi_exact), 1e-6 * xi_exact + 1e-8);
+}
+
+TEST(TestModel, TestXiNewton) {
+  DarkSunParameters params{7, 1e-3};
+
+  // Analytic derivative of log(heff) against central differences
+  for (double td : {1e-6, 1e-4, 1e-3, 1e-2, 1.0}) {
+    const auto lh = dark_log_heff(td, params);
+    ASSERT_NEAR(lh.first, log(dark_heff(td, params)), 1e-12);
+    const double h = 1e-5;
+    const double fd = (dark_log_heff(td * exp(h), params).first -
+                       dark_log_heff(td * exp(-h), params).first) /
+                      (2.0 * h);
+    ASSERT_NEAR(lh.second, fd, 1e-6 * std::abs(fd) + 1e-8);
+  }
+
+  // Deep in the Boltzmann tail heff underflows, but its log does not
+  ASSERT_TRUE(std::isfinite(dark_log_heff(1e-8, params).first));
+
+  // Newton from cold and warm starts against a tight bisection
+  auto bisect_xi = [&params](double tsm) {
+    const double c1 = StandardModel::heff(tsm) * dark_heff_inf(params) *
+                      std::pow(params.xi_inf, 3) / StandardModel::HEFF_INF;
+    const auto bounds = xi_bounds_const_tsm(tsm, params);
+    double lo = 0.8 * bounds.first;
+    double hi = 1.2 * bounds.second;
+    for (int i = 0; i < 200; i++) {
+      const double mid = 0.5 * (lo + hi);
+      const double f = dark_heff(mid * tsm, params) * std::pow(mid, 3) - c1;
+      (f < 0.0 ? lo : hi) = mid;
+    }
+    return 0.5 * (lo + hi);
+  };
+  for (double tsm : {1e-12, 1e-8, 1e-6, 1e-4, 1e-2}) {
+    const double xi = bisect_xi(tsm);
+    params.xi_hint = -1.0;
+    ASSERT_NEAR(solve_xi_const_tsm(tsm, params), xi, 1e-9 * xi);
+    // Warm starts from a nearby and a distant root
+    params.xi_hint = 1.01 * xi;
+    ASSERT_NEAR(solve_xi_const_tsm(tsm, params), xi, 1e-9 * xi);
+    solve_xi_const_tsm(1.0, params);
+    ASSERT_NEAR(solve_xi_const_tsm(tsm, params), xi, 1e-9 * xi);
+  }
+}
+
+TEST(TestModel, TestThermalCrossSectionTable) {
+  DarkSunParameters params{10, 1e-1};
+
+  for (double x : {0.5, 1.0, 2.5, 5.0, 10.0, 20.0, 50.0, 200.0, 1e3}) {
+    const double sige = thermal_cross_section_4eta_2eta(x, params);
+    const double sige_tab =
+        tabulated_thermal_cross_section_4eta_2eta(x, params);
+    fmt::print("x = {}, 4eta->2eta: {}, {}\n", x, sige, sige_tab);
+    ASSERT_LE(std::abs(sige - sige_tab) / sige, 1e-4);
+  }
+
+  // Beyond the tables, the threshold expansion must join the tables and
+  // approach its limit as x -> inf.
+  const double x_max = ThermalCrossSectionCache::tables_4eta_2eta()[0]->x_max();
+  const double below =
+      tabulated_thermal_cross_section_4eta_2eta(x_max * (1.0 - 1e-9), params);
+  const double above =
+      tabulated_thermal_cross_section_4eta_2eta(x_max * (1.0 + 1e-9), params);
+  ASSERT_NEAR(above / below, 1.0, 1e-8);
+
+  const auto cs = cross_section_2eta_4eta_coefficients(params);
+  const auto coeffs = ScaledEtaCrossSection::threshold_coefficients();
+  double limit = 0.0;
+  for (size_t i = 0; i < 3; i++) {
+    limit += cs[i] * 1260.0 * M_SQRT2 / M_PI * coeffs[i];
+  }
+  limit *= std::pow(M_PI, 4) / std::pow(m_eta(params), 6);
+  for (double x : {1e6, 1e8, 1e10}) {
+    const double sige_tab =
+        tabulated_thermal_cross_section_4eta_2eta(x, params);
+    ASSERT_NEAR(sige_tab / limit, 1.0, 1e-3 * x_max / x);
+  }
+}
+
+TEST(TestModel, TestThermalIntegralConstantCrossSection) {
+  // The closed form against the quadrature it replaced
+  const double inf = std::numeric_limits<double>::infinity();
+  for (double zmin : {2.0, 2.0001, 2.5, 6.32, 40.0}) {
+    for (double x : {1e-2, 0.1, 1.0, 10.0, 100.0, 1e3, 1e4}) {
+      auto f = [x](const ThermalNodes &z, ThermalNodes &fz) {
+        thermal_kernel(x, 2.0, z, fz);
+      };
+      const double expected =
+          BatchGaussKronrod15::integrate(f, zmin, inf, 15, 1e-12);
+      if (expected == 0.0) {
+        continue;
+      }
+      ASSERT_NEAR(thermal_integral_constant_cross_section(x, zmin) / expected,
+                  1.0, 1e-11);
+    }
+  }
+}
+
+TEST(TestModel, TestUniformCubicSpline) {
+  // Compare against GSL's natural cubic spline on the same data
+  constexpr size_t num = 41;
+  const double x_min = -2.0;
+  const double x_step = 0.1;
+  std::vector<double> xs(num);
+  std::vector<double> ys(num);
+  for (size_t i = 0; i < num; i++) {
+    xs[i] = x_min + double(i) * x_step;
+    ys[i] = sin(3.0 * xs[i]) * exp(-xs[i]);
+  }
+  gsl_spline *spline = gsl_spline_alloc(gsl_interp_cspline, num);
+  gsl_spline_init(spline, xs.data(), ys.data(), num);
+  UniformCubicSpline uspline(x_min, x_step, ys.data(), num);
+
+  for (size_t i = 0; i <= 400; i++) {
+    const double x = xs.front() + (xs.back() - xs.front()) * double(i) / 400;
+    const double expected = gsl_spline_eval(spline, x, nullptr);
+    ASSERT_NEAR(uspline(x), expected, 1e-12 * std::max(1.0, std::abs(expected)));
+  }
+  gsl_spline_free(spline);
+}
+
+TEST(TestModel, TestScaledEtaCrossSection) {
+  // The one-pass evaluation must agree with the individual channels, both on
+  // the interpolated data and on the large-z fit.
+  for (double z : {3.0, 4.5, 10.0, 37.0, 99.9, 100.0, 250.0}) {
+    const auto cs = ScaledEtaCrossSection::scaled_cs_eta(z);
+    ASSERT_DOUBLE_EQ(cs[0], ScaledEtaCrossSection::scaled_cs_eta_44(z));
+    ASSERT_DOUBLE_EQ(cs[1], ScaledEtaCrossSection::scaled_cs_eta_66(z));
+    ASSERT_DOUBLE_EQ(cs[2], ScaledEtaCrossSection::scaled_cs_eta_46(z));
+  }
+  const auto below = ScaledEtaCrossSection::scaled_cs_eta(3.9);
+  ASSERT_EQ(below[0] + below[1] + below[2], 0.0);
+
+  // Just above threshold, the cross-sections go as (z - 4)^(7/2)
+  const auto coeffs = ScaledEtaCrossSection::threshold_coefficients();
+  for (double dz : {1e-9, 1e-6, 1e-4}) {
+    const auto cs = ScaledEtaCrossSection::scaled_cs_eta(4.0 + dz);
+    for (size_t j = 0; j < 3; j++) {
+      ASSERT_NEAR(cs[j] / std::pow(dz, 3.5) / coeffs[j], 1.0, 1e-3);
+    }
+  }
+
+  // The uniform-grid splines against the data and against the GSL cubic
+  // splines they replaced, built from the same table. The end points are
+  // left out since log10(10^x) may round outside of the data range. Near
+  // threshold, the splines are replaced and only the data is compared.
+  constexpr size_t num = ScaledEtaCrossSection::NUM_DATA;
+  constexpr size_t num_thr = ScaledEtaCrossSection::NUM_THRESHOLD_DATA;
+  const auto data = ScaledEtaCrossSection::data();
+  for (size_t j = 0; j < 3; j++) {
+    gsl_spline *spline = gsl_spline_alloc(gsl_interp_cspline, num);
+    gsl_spline_init(spline, data[0], data[j + 1], num);
+    for (size_t i = 1; i < num - 1; i++) {
+      const double logz = data[0][i];
+      const auto cs = ScaledEtaCrossSection::scaled_cs_eta(pow(10.0, logz));
+      ASSERT_NEAR(log10(cs[j]), data[j + 1][i], 1e-12);
+      if (i + 1 < num_thr) {
+        continue;
+      }
+
+      const double mid = 0.5 * (logz + data[0][i + 1]);
+      const double expected = gsl_spline_eval(spline, mid, nullptr);
+      const double cs_mid =
+          ScaledEtaCrossSection::scaled_cs_eta(pow(10.0, mid))[j];
+      ASSERT_NEAR(log10(cs_mid), expected, 1e-12);
+    }
+    gsl_spline_free(spline);
+  }
+}
@@ -154,4 +154,397 @@ TEST(TestRadau, TestVanDerPol) {
     ASSERT_LE(abs((mma[i][1] - y0) / mma[i][1]), 1e-4);
     ASSERT_LE(abs((mma[i][2] - y1) / mma[i][2]), 1e-4);
   }
-}
\ No newline at end of file
+}
+
+TEST(TestRadau, TestStdFunctionAdapter) {
+  // The std::function overload must give the same result as the templated
+  // entry point with the same callbacks.
+  auto solve = [](auto fcn, auto jac, auto mas, auto solout) {
+    int nd = 1, ns = 7, ijac = 1, mljac = 1, mujac = 0;
+    int imas = 0, mlmas = 0, mumas = 0, itol = 0, iout = 0, idid;
+    int lwork = (ns + 1) * nd * nd + (3 * ns + 3) * nd + 20;
+    int liwork = (2 + (ns - 1) / 2) * nd + 20;
+    std::vector<double> work(lwork, 0.0);
+    std::vector<int> iwork(liwork, 0);
+    double rtol = 1e-10, atol = 1e-10, h = 1e-6;
+    double x = 0.0, xend = 1.0;
+    double y[1] = {1.0};
+    radau(&nd, fcn, &x, y, &xend, &h, &rtol, &atol, &itol, jac, &ijac, &mljac,
+          &mujac, mas, &imas, &mlmas, &mumas, solout, &iout, work.data(),
+          &lwork, iwork.data(), &liwork, &idid);
+    EXPECT_GT(idid, 0);
+    return y[0];
+  };
+  auto fcn = [](int *, double *, double *y, double *dy) { dy[0] = -y[0]; };
+  auto jac = [](int *, double *, double *, double *dfy, int *) {
+    dfy[0] = -1.0;
+  };
+  auto mas = [](int *, double *, int *) {};
+  auto solout = [](int *, double *, double *, double *, double *, int *,
+                   int *, int *, RadauWeight &) {};
+
+  const double y_template = solve(fcn, jac, mas, solout);
+  const double y_function =
+      solve(F_fcn(fcn), F_jac(jac), F_mas(mas), F_solout(solout));
+  ASSERT_NEAR(y_template, exp(-1.0), 1e-8);
+  ASSERT_EQ(y_template, y_function);
+}
+
+TEST(TestRadau, TestRadau5VanDerPol) {
+  constexpr double eps = 1e-6;
+  auto vdpol = [](double, const std::array<double, 2> &y,
+                  std::array<double, 2> &dy) {
+    dy[0] = y[1];
+    dy[1] = ((1 - y[0] * y[0]) * y[1] - y[0]) / eps;
+  };
+  auto jvpol = [](double, const std::array<double, 2> &y,
+                  std::array<std::array<double, 2>, 2> &dfy) {
+    dfy[0][0] = 0.0;
+    dfy[0][1] = 1.0;
+    dfy[1][0] = (-2.0 * y[0] * y[1] - 1.0) / eps;
+    dfy[1][1] = (1 - y[0] * y[0]) / eps;
+  };
+
+  // Mathematica solution at x = 0.5, 1, 1.5
+  const std::vector<std::array<double, 3>> mma{
+      {0.5, 1.5967684573030676, -1.0303919311654355},
+      {1.0, -1.8636457734095244, 0.7535434289873758},
+      {1.5, -1.3547447410455409, 1.6217935234704024}};
+  size_t k = 0;
+  auto solout = [&](int, double xold, double x, const std::array<double, 2> &,
+                    const Radau5<2> &solver) {
+    while (k < mma.size() && xold <= mma[k][0] && mma[k][0] <= x) {
+      EXPECT_NEAR(solver.dense(0, mma[k][0]), mma[k][1], 1e-4);
+      EXPECT_NEAR(solver.dense(1, mma[k][0]), mma[k][2], 1e-4);
+      k++;
+    }
+    return true;
+  };
+
+  Radau5<2> solver;
+  solver.rtol = 1e-9;
+  solver.atol = 1e-9;
+  std::array<double, 2> y = {2.0, -0.66};
+  double x = 0.0;
+  double h = 1e-6;
+  ASSERT_EQ(solver.integrate(vdpol, jvpol, x, y, 2.0, h, solout), 1);
+  ASSERT_EQ(k, mma.size());
+  ASSERT_EQ(x, 2.0);
+  ASSERT_NEAR(y[0], 1.706166942293804, 1e-5);
+  ASSERT_NEAR(y[1], -0.8928105392359631, 1e-5);
+}
+
+TEST(TestRadau, TestRadau5Robertson) {
+  // Exercises the generic small LU decompositions (N = 3)
+  using Vec = std::array<double, 3>;
+  auto rober = [](double, const Vec &y, Vec &dy) {
+    dy[0] = -0.04 * y[0] + 1e4 * y[1] * y[2];
+    dy[2] = 3e7 * y[1] * y[1];
+    dy[1] = -dy[0] - dy[2];
+  };
+  auto jrober = [](double, const Vec &y, std::array<Vec, 3> &dfy) {
+    dfy[0] = {-0.04, 1e4 * y[2], 1e4 * y[1]};
+    dfy[2] = {0.0, 6e7 * y[1], 0.0};
+    dfy[1] = {0.04, -1e4 * y[2] - 6e7 * y[1], -1e4 * y[1]};
+  };
+  auto solout = [](int, double, double, const Vec &, const Radau5<3> &) {
+    return true;
+  };
+
+  Radau5<3> solver;
+  solver.rtol = 1e-10;
+  solver.atol = 1e-14;
+  Vec y = {1.0, 0.0, 0.0};
+  double x = 0.0;
+  double h = 1e-6;
+  ASSERT_EQ(solver.integrate(rober, jrober, x, y, 40.0, h, solout), 1);
+  ASSERT_NEAR(y[0], 0.7158270687, 1e-8);
+  ASSERT_NEAR(y[1] / 9.185534764e-6, 1.0, 1e-6);
+  ASSERT_NEAR(y[2], 0.2841637457, 1e-8);
+}
+
+TEST(TestRadau, TestRadauSolverReuse) {
+  // Reusing the workspace must give bit-identical results to a fresh call
+  auto fcn = [](int *, double *x, double *y, double *dy) {
+    dy[0] = y[1];
+    dy[1] = -y[0] - 100.0 * y[1] + std::sin(*x);
+  };
+  auto jac = [](int *, double *, double *, double *dfy, int *) {
+    dfy[0] = 0.0;
+    dfy[1] = -1.0;
+    dfy[2] = 1.0;
+    dfy[3] = -100.0;
+  };
+  auto mas = [](int *, double *, int *) {};
+  auto solout = [](int *, double *, double *, double *, double *, int *,
+                   int *, int *, RadauWeight &) {};
+
+  int nd = 2, ns = 7, ijac = 1, mljac = 2, mujac = 0;
+  int imas = 0, mlmas = 0, mumas = 0, itol = 0, iout = 0;
+  double rtol = 1e-8, atol = 1e-8;
+  RadauSolver solver(nd);
+  solver.options[6] = 0.5; // Maximal step size
+
+  for (double y0 : {1.0, -3.0, 0.25}) {
+    int lwork = (ns + 1) * nd * nd + (3 * ns + 3) * nd + 20;
+    int liwork = (2 + (ns - 1) / 2) * nd + 20;
+    std::vector<double> work(lwork, 0.0);
+    std::vector<int> iwork(liwork, 0);
+    work[6] = 0.5;
+    int idid_fresh, idid_reused;
+    double x1 = 0.0, x2 = 0.0, xend = 10.0, h1 = 1e-6, h2 = 1e-6;
+    double y1[2] = {y0, 0.0};
+    double y2[2] = {y0, 0.0};
+    radau(&nd, fcn, &x1, y1, &xend, &h1, &rtol, &atol, &itol, jac, &ijac,
+          &mljac, &mujac, mas, &imas, &mlmas, &mumas, solout, &iout,
+          work.data(), &lwork, iwork.data(), &liwork, &idid_fresh);
+    solver.solve(fcn, &x2, y2, &xend, &h2, &rtol, &atol, &itol, jac, &ijac,
+                 &mljac, &mujac, mas, &imas, &mlmas, &mumas, solout, &iout,
+                 &idid_reused);
+    ASSERT_EQ(idid_fresh, 1);
+    ASSERT_EQ(idid_reused, 1);
+    ASSERT_EQ(y1[0], y2[0]);
+    ASSERT_EQ(y1[1], y2[1]);
+    ASSERT_EQ(solver.stats().nfcn, iwork[13]);
+    ASSERT_EQ(solver.stats().naccpt, iwork[16]);
+  }
+}
+
+TEST(TestRadau, TestRadau5Statistics) {
+  using Vec = std::array<double, 2>;
+  auto fcn = [](double, const Vec &y, Vec &dy) {
+    dy[0] = y[1];
+    dy[1] = -y[0] - 100.0 * y[1];
+  };
+  auto jac = [](double, const Vec &, std::array<Vec, 2> &dfy) {
+    dfy[0] = {0.0, 1.0};
+    dfy[1] = {-1.0, -100.0};
+  };
+  size_t num_calls = 0;
+  auto solout = [&num_calls](int, double, double, const Vec &,
+                             const Radau5<2> &) {
+    num_calls++;
+    return true;
+  };
+
+  Radau5<2> solver;
+  for (bool timing : {false, true}) {
+    Vec y = {1.0, 0.0};
+    double x = 0.0;
+    double h = 1e-6;
+    num_calls = 0;
+    solver.timing = timing;
+    ASSERT_EQ(solver.integrate(fcn, jac, x, y, 10.0, h, solout), 1);
+
+    const SolverStats &stats = solver.stats;
+    // solout is called at the initial point and after every accepted step
+    ASSERT_EQ(num_calls, size_t(stats.naccpt) + 1);
+    ASSERT_GE(stats.nstep, stats.naccpt + stats.nrejct);
+    ASSERT_GE(stats.nfcn, 3 * stats.nsol);
+    ASSERT_GT(stats.njac, 0);
+    ASSERT_GE(stats.ndec, stats.njac);
+    if (timing) {
+      ASSERT_GT(stats.time_fcn, 0.0);
+      ASSERT_GT(stats.time_dec, 0.0);
+    } else {
+      ASSERT_EQ(stats.time_fcn, 0.0);
+      ASSERT_EQ(stats.time_jac, 0.0);
+      ASSERT_EQ(stats.time_dec, 0.0);
+      ASSERT_EQ(stats.time_sol, 0.0);
+    }
+  }
+}
+
+TEST(TestRadau, TestRodasVanDerPol) {
+  constexpr double eps = 1e-6;
+  auto vdpol = [](double, const std::array<double, 2> &y,
+                  std::array<double, 2> &dy) {
+    dy[0] = y[1];
+    dy[1] = ((1 - y[0] * y[0]) * y[1] - y[0]) / eps;
+  };
+  auto jvpol = [](double, const std::array<double, 2> &y,
+                  std::array<std::array<double, 2>, 2> &dfy) {
+    dfy[0][0] = 0.0;
+    dfy[0][1] = 1.0;
+    dfy[1][0] = (-2.0 * y[0] * y[1] - 1.0) / eps;
+    dfy[1][1] = (1 - y[0] * y[0]) / eps;
+  };
+
+  // Mathematica solution at x = 0.5, 1, 1.5
+  const std::vector<std::array<double, 3>> mma{
+      {0.5, 1.5967684573030676, -1.0303919311654355},
+      {1.0, -1.8636457734095244, 0.7535434289873758},
+      {1.5, -1.3547447410455409, 1.6217935234704024}};
+  size_t k = 0;
+  auto solout = [&](int, double xold, double x, const std::array<double, 2> &,
+                    const Rodas<2> &solver) {
+    while (k < mma.size() && xold <= mma[k][0] && mma[k][0] <= x) {
+      EXPECT_NEAR(solver.dense(0, mma[k][0]), mma[k][1], 1e-4);
+      EXPECT_NEAR(solver.dense(1, mma[k][0]), mma[k][2], 1e-4);
+      k++;
+    }
+    return true;
+  };
+
+  Rodas<2> solver;
+  solver.rtol = 1e-9;
+  solver.atol = 1e-9;
+  solver.autonomous = true;
+  std::array<double, 2> y = {2.0, -0.66};
+  double x = 0.0;
+  double h = 1e-6;
+  ASSERT_EQ(solver.integrate(vdpol, jvpol, x, y, 2.0, h, solout), 1);
+  ASSERT_EQ(k, mma.size());
+  ASSERT_EQ(x, 2.0);
+  ASSERT_NEAR(y[0], 1.706166942293804, 1e-5);
+  ASSERT_NEAR(y[1], -0.8928105392359631, 1e-5);
+  // One Jacobian and one decomposition per step, no Newton iterations
+  ASSERT_EQ(solver.stats.njac, solver.stats.naccpt);
+  ASSERT_EQ(solver.stats.nsol, 6 * solver.stats.ndec);
+}
+
+TEST(TestRadau, TestRodasNonAutonomous) {
+  // Stiff relaxation onto cos(x), with df/dx computed by finite differences
+  using Vec = std::array<double, 1>;
+  constexpr double lam = 1e3;
+  auto fcn = [](double x, const Vec &y, Vec &dy) {
+    dy[0] = -lam * (y[0] - std::cos(x));
+  };
+  auto jac = [](double, const Vec &, std::array<Vec, 1> &dfy) {
+    dfy[0][0] = -lam;
+  };
+  auto exact = [](double x) {
+    return lam * (lam * std::cos(x) + std::sin(x)) / (lam * lam + 1.0);
+  };
+  double max_err = 0.0;
+  auto solout = [&](int, double xold, double x, const Vec &,
+                    const Rodas<1> &solver) {
+    const double xmid = 0.5 * (xold + x);
+    max_err = std::max(max_err, std::abs(solver.dense(0, xmid) - exact(xmid)));
+    return true;
+  };
+
+  Rodas<1> solver;
+  solver.rtol = 1e-8;
+  solver.atol = 1e-8;
+  Vec y = {exact(0.0)};
+  double x = 0.0;
+  double h = 1e-6;
+  ASSERT_EQ(solver.integrate(fcn, jac, x, y, 3.0, h, solout), 1);
+  ASSERT_NEAR(y[0], exact(3.0), 1e-7);
+  ASSERT_LT(max_err, 1e-6);
+}
+
+TEST(TestRadau, TestDopri5) {
+  using Vec = std::array<double, 2>;
+  // Harmonic oscillator, checking the solution and the dense output
+  auto osc = [](double, const Vec &y, Vec &dy) {
+    dy[0] = y[1];
+    dy[1] = -y[0];
+  };
+  double max_err = 0.0;
+  auto solout = [&max_err](int, double xold, double x, const Vec &,
+                           const Dopri5<2> &solver) {
+    const double xmid = 0.5 * (xold + x);
+    max_err = std::max(max_err, std::abs(solver.dense(0, xmid) - cos(xmid)));
+    return true;
+  };
+  Dopri5<2> solver;
+  solver.rtol = 1e-10;
+  solver.atol = 1e-10;
+  Vec y = {1.0, 0.0};
+  double x = 0.0;
+  double h = 1e-3;
+  ASSERT_EQ(solver.integrate(osc, x, y, 10.0, h, solout), 1);
+  ASSERT_EQ(x, 10.0);
+  ASSERT_NEAR(y[0], cos(10.0), 1e-8);
+  ASSERT_NEAR(y[1], -sin(10.0), 1e-8);
+  ASSERT_LT(max_err, 1e-8);
+
+  // A stiff problem must be detected and reported
+  auto stiff = [](double x, const Vec &y, Vec &dy) {
+    dy[0] = -1e4 * (y[0] - cos(x));
+    dy[1] = y[0];
+  };
+  auto noout = [](int, double, double, const Vec &, const Dopri5<2> &) {
+    return true;
+  };
+  solver.nstiff = 1;
+  y = {1.0, 0.0};
+  x = 0.0;
+  h = 1e-3;
+  ASSERT_EQ(solver.integrate(stiff, x, y, 10.0, h, noout), -4);
+  ASSERT_LT(x, 10.0);
+}
+
+TEST(TestRadau, TestDualJacobian) {
+  // The Jacobian of the Van der Pol equation from automatic differentiation
+  constexpr double eps = 1e-6;
+  auto vdpol = [](double, const auto &y, auto &dy) {
+    dy[0] = y[1];
+    dy[1] = ((1 - y[0] * y[0]) * y[1] - y[0]) / eps;
+  };
+  const std::array<double, 2> y = {2.0, -0.66};
+  std::array<std::array<double, 2>, 2> dfy{};
+  jacobian<2>(vdpol, 0.0, y, dfy);
+  ASSERT_DOUBLE_EQ(dfy[0][0], 0.0);
+  ASSERT_DOUBLE_EQ(dfy[0][1], 1.0);
+  ASSERT_DOUBLE_EQ(dfy[1][0], (-2.0 * y[0] * y[1] - 1.0) / eps);
+  ASSERT_DOUBLE_EQ(dfy[1][1], (1 - y[0] * y[0]) / eps);
+
+  // Elementary functions
+  auto fcn = [](double, const auto &y, auto &dy) {
+    dy[0] = exp(y[0]) * log(y[1]);
+    dy[1] = sqrt(y[0]) / pow(y[1], 3.0);
+  };
+  const std::array<double, 2> z = {0.5, 2.0};
+  jacobian<2>(fcn, 0.0, z, dfy);
+  ASSERT_DOUBLE_EQ(dfy[0][0], std::exp(z[0]) * std::log(z[1]));
+  ASSERT_DOUBLE_EQ(dfy[0][1], std::exp(z[0]) / z[1]);
+  ASSERT_DOUBLE_EQ(dfy[1][0], 0.5 / std::sqrt(z[0]) / std::pow(z[1], 3.0));
+  ASSERT_DOUBLE_EQ(dfy[1][1], -3.0 * std::sqrt(z[0]) / std::pow(z[1], 4.0));
+}
+
+TEST(TestRadau, TestEventLocation) {
+  // The first zero of cos(x), located on the dense output of RADAU5
+  using Vec = std::array<double, 2>;
+  auto osc = [](double, const Vec &y, Vec &dy) {
+    dy[0] = y[1];
+    dy[1] = -y[0];
+  };
+  auto jac = [](double, const Vec &, std::array<Vec, 2> &dfy) {
+    dfy[0] = {0.0, 1.0};
+    dfy[1] = {-1.0, 0.0};
+  };
+  Event zero;
+  int num_fired = 0;
+  auto solout = [&](int, double xold, double x, const Vec &,
+                    const Radau5<2> &solver) {
+    if (zero.check(xold, x, [&](double t) { return solver.dense(0, t); })) {
+      num_fired++;
+    }
+    return true;
+  };
+  Radau5<2> solver;
+  solver.rtol = 1e-10;
+  solver.atol = 1e-10;
+  Vec y = {1.0, 0.0};
+  double x = 0.0;
+  double h = 1e-3;
+  ASSERT_EQ(solver.integrate(osc, jac, x, y, 10.0, h, solout), 1);
+  // cos(x) has three zeros in [0, 10], but the event only fires once
+  ASSERT_EQ(num_fired, 1);
+  ASSERT_TRUE(zero.has_fired());
+  ASSERT_NEAR(zero.location(), M_PI / 2.0, 1e-8);
+
+  // A repeating event fires at every zero
+  zero.reset();
+  zero.once = false;
+  num_fired = 0;
+  y = {1.0, 0.0};
+  x = 0.0;
+  h = 1e-3;
+  ASSERT_EQ(solver.integrate(osc, jac, x, y, 10.0, h, solout), 1);
+  ASSERT_EQ(num_fired, 3);
+  ASSERT_NEAR(zero.location(), 5.0 * M_PI / 2.0, 1e-8);
+}
@@ -2,4 +2,329 @@
 // Created by logan on 8/10/20.
 //
 
-#include <darksun/scanner.hpp>
\ No newline at end of file
+#include <darksun/adaptive_scanner.hpp>
+#include <darksun/scanner.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace darksun;
+
+TEST(TestScanner, TestIndexDispenser) {
+  // Every index must be handed out exactly once, even when some workers are
+  // much slower than others and their blocks get stolen.
+  constexpr size_t num = 10007;
+  constexpr size_t num_workers = 8;
+  IndexDispenser dispenser(num, num_workers);
+  std::vector<std::vector<size_t>> taken(num_workers);
+  std::vector<std::thread> threads;
+  for (size_t w = 0; w < num_workers; w++) {
+    threads.emplace_back([&, w] {
+      size_t idx;
+      while (dispenser.next(w, idx)) {
+        taken[w].push_back(idx);
+        if (w == 0) {
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::vector<int> counts(num, 0);
+  for (const auto &idxs : taken) {
+    for (auto idx : idxs) {
+      ASSERT_LT(idx, num);
+      counts[idx]++;
+    }
+  }
+  for (size_t i = 0; i < num; i++) {
+    ASSERT_EQ(counts[i], 1) << "index " << i;
+  }
+  // The slow worker's block should have been stolen by the others
+  ASSERT_LT(taken[0].size(), num / num_workers);
+}
+
+TEST(TestScanner, TestIndexDispenserUnbounded) {
+  IndexDispenser dispenser(0, 2);
+  size_t idx;
+  for (size_t i = 0; i < 5; i++) {
+    ASSERT_TRUE(dispenser.next(i % 2, idx));
+    ASSERT_EQ(idx, i);
+  }
+}
+
+TEST(TestScanner, TestOrderedCsvResultSink) {
+  // Rows written out of order from several workers must come out sorted by
+  // grid index.
+  constexpr size_t num = 2000;
+  constexpr size_t num_workers = 4;
+  const std::string fname = "test_ordered_result_sink.csv";
+  {
+    CsvResultSink sink(fname, num_workers, true);
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < num_workers; w++) {
+      threads.emplace_back([&, w] {
+        for (size_t k = w; k < num; k += num_workers) {
+          const size_t i = num - 1 - k;
+          auto params = DarkSunParameters{double(i), 0.0};
+          sink.write(w, i, params);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    sink.close();
+  }
+
+  std::ifstream ifile(fname);
+  std::string line;
+  std::getline(ifile, line);
+  ASSERT_EQ(line, result_header());
+  for (size_t i = 0; i < num; i++) {
+    ASSERT_TRUE(std::getline(ifile, line));
+    ASSERT_EQ(line.substr(0, line.find(',')), std::to_string(i));
+  }
+  ASSERT_FALSE(std::getline(ifile, line));
+  ifile.close();
+  std::remove(fname.c_str());
+}
+
+TEST(TestScanner, TestBinaryResultSink) {
+  constexpr size_t num = 100;
+  const std::string fname = "test_binary_result_sink.bin";
+  {
+    BinaryResultSink sink(fname, 2, num);
+    for (size_t i = 0; i < num; i += 2) {
+      // Leave out the last row to check that it is filled with NaN
+      for (size_t w = 0; w < 2 && i + w < num - 1; w++) {
+        auto params = DarkSunParameters{double(i + w), 0.5};
+        sink.write(w, i + w, params);
+      }
+    }
+    sink.close();
+  }
+
+  std::ifstream ifile(fname, std::ios::binary);
+  char magic[8];
+  uint64_t sizes[3];
+  ifile.read(magic, 8);
+  ifile.read(reinterpret_cast<char *>(sizes), sizeof(sizes));
+  ASSERT_EQ(std::string(magic, 8), "DSNCOL01");
+  ASSERT_EQ(sizes[0], NUM_RESULT_COLUMNS);
+  ASSERT_EQ(sizes[1], num);
+  ASSERT_EQ(sizes[2] % 64, 0);
+  std::string names(sizes[2] - 32, '\0');
+  ifile.read(&names[0], std::streamsize(names.size()));
+  ASSERT_EQ(std::string(names.c_str()), result_header());
+
+  // Columns N and LAM
+  std::vector<double> cols(2 * num);
+  ifile.read(reinterpret_cast<char *>(cols.data()),
+             std::streamsize(8 * cols.size()));
+  for (size_t i = 0; i < num - 1; i++) {
+    ASSERT_EQ(cols[i], double(i));
+    ASSERT_EQ(cols[num + i], 0.5);
+  }
+  ASSERT_TRUE(std::isnan(cols[num - 1]));
+  ifile.close();
+  std::remove(fname.c_str());
+}
+
+TEST(TestScanner, TestResumeFromJournal) {
+  // Simulate a scan killed in the middle of writing a block: the output has
+  // rows past the last journal entry and the journal has an incomplete line.
+  constexpr size_t num = 50;
+  const std::string fname = "test_resume_result_sink.csv";
+  const std::string jname = fname + ".journal";
+  std::remove(fname.c_str());
+  std::remove(jname.c_str());
+
+  auto recovered = recover_scan_journal(fname, jname);
+  ASSERT_TRUE(recovered.empty());
+  {
+    CsvResultSink sink(fname, 1, true, jname, recovered);
+    for (size_t i = 0; i < num / 2; i++) {
+      sink.write(0, i, DarkSunParameters{double(i), 0.0});
+    }
+    sink.close();
+  }
+  {
+    std::ofstream ofile(fname, std::ios::app);
+    ofile << "25,0,1,1,0.1,1,1,1,0.01,0.1,0.1,0.1,0.1,0.1,0.1,0,0,0,0\n26,";
+    std::ofstream journal(jname, std::ios::app);
+    journal << "1234 25";
+  }
+
+  recovered = recover_scan_journal(fname, jname);
+  ASSERT_EQ(recovered.size(), num / 2);
+  {
+    CsvResultSink sink(fname, 1, true, jname, recovered);
+    for (size_t i = num / 2; i < num; i++) {
+      sink.write(0, i, DarkSunParameters{double(i), 0.0});
+    }
+    sink.close();
+  }
+
+  std::ifstream ifile(fname);
+  std::string line;
+  std::getline(ifile, line);
+  ASSERT_EQ(line, result_header());
+  for (size_t i = 0; i < num; i++) {
+    ASSERT_TRUE(std::getline(ifile, line));
+    ASSERT_EQ(line.substr(0, line.find(',')), std::to_string(i));
+  }
+  ASSERT_FALSE(std::getline(ifile, line));
+  ifile.close();
+  ASSERT_EQ(recover_scan_journal(fname, jname).size(), num);
+  std::remove(fname.c_str());
+  std::remove(jname.c_str());
+}
+
+TEST(TestScanner, TestJournalBoundedRows) {
+  // A journaled sink must not hold more than `JOURNAL_ROWS` rows of a worker
+  // back from the journal, however small the rows are.
+  const std::string fname = "test_journal_rows.csv";
+  const std::string jname = fname + ".journal";
+  std::remove(fname.c_str());
+  std::remove(jname.c_str());
+  constexpr size_t rows = CsvResultSink::JOURNAL_ROWS;
+  CsvResultSink sink(fname, 1, false, jname);
+  for (size_t i = 0; i < rows; i++) {
+    sink.write(0, i, DarkSunParameters{double(i), 0.0});
+  }
+  // The writer thread journals the rows asynchronously
+  size_t journaled = 0;
+  for (int attempt = 0; attempt < 500 && journaled < rows; attempt++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::ifstream journal(jname);
+    std::string line;
+    if (std::getline(journal, line)) {
+      journaled = size_t(std::count(line.begin(), line.end(), ' '));
+    }
+  }
+  ASSERT_EQ(journaled, rows);
+  sink.close();
+  std::remove(fname.c_str());
+  std::remove(jname.c_str());
+}
+
+TEST(TestScanner, TestResumeWithoutJournal) {
+  // Without a journal nothing is known about the rows of a non-empty output,
+  // so recovery must refuse to resume and leave the file as it is.
+  const std::string fname = "test_resume_no_journal.csv";
+  const std::string jname = fname + ".journal";
+  const std::string contents = result_header() + "\n0,0\n";
+  std::remove(jname.c_str());
+  {
+    std::ofstream ofile(fname);
+    ofile << contents;
+  }
+  ASSERT_THROW(recover_scan_journal(fname, jname), std::runtime_error);
+  {
+    std::ifstream ifile(fname);
+    std::stringstream ss;
+    ss << ifile.rdbuf();
+    ASSERT_EQ(ss.str(), contents);
+  }
+  ASSERT_FALSE(std::filesystem::exists(jname));
+
+  // An empty output file is simply started afresh
+  {
+    std::ofstream ofile(fname);
+  }
+  ASSERT_TRUE(recover_scan_journal(fname, jname).empty());
+  ASSERT_TRUE(std::filesystem::exists(jname));
+  std::remove(fname.c_str());
+  std::remove(jname.c_str());
+}
+
+TEST(TestScanner, TestPrescreen) {
+  // Only the point whose estimated relic density is close to the target may
+  // reach the solver. The other keeps its estimate and is flagged.
+  struct RecordingSink final : public ResultSink {
+    std::array<std::array<double, 3>, 2> rows{};
+    void write(size_t, size_t idx, const DarkSunParameters &params) override {
+      rows[idx] = {params.rd_eta, params.rd_del, double(params.skipped)};
+    }
+    void close() override {}
+  };
+  const std::array<double, 2> lams = {1e-5, 1e1};
+
+  Scanner scanner(
+      "",
+      [&lams](size_t i, DarkSunParameters &params) {
+        params.n = 7;
+        params.lam = lams[i];
+        params.c = 0.666544284531189;
+        return false;
+      },
+      lams.size(), 1);
+  scanner.show_progress = false;
+  scanner.prescreen = true;
+  scanner.prescreen_band = 10.0;
+  scanner.solve_model = [](DarkSunParameters &params) {
+    params.rd_eta = -1.0;
+  };
+  RecordingSink sink;
+  scanner.scan(sink);
+
+  ASSERT_EQ(sink.rows[0][0], -1.0);
+  ASSERT_EQ(sink.rows[0][2], 0.0);
+  ASSERT_GT(sink.rows[1][0] + sink.rows[1][1], 10.0 * OMEGA_H2_CDM);
+  ASSERT_EQ(sink.rows[1][2], 1.0);
+}
+
+TEST(TestScanner, TestAdaptiveScanner) {
+  // Resolve a circle with an analytic "solver" standing in for the Boltzmann
+  // equation.
+  const double x0 = 0.1;
+  const double y0 = 0.05;
+  const double r = 0.9;
+  const std::string fname = "test_adaptive_scanner.csv";
+  AdaptiveScanner scanner(
+      fname, ScanAxis{-2.0, 2.0, 9}, ScanAxis{-2.0, 2.0, 9},
+      [](double x, double y, DarkSunParameters &params) {
+        params.n = x;
+        params.lam = y;
+      },
+      {[](const DarkSunParameters &params) { return params.rd_eta; }}, 4);
+  scanner.show_progress = false;
+  scanner.solve_model = [=](DarkSunParameters &params) {
+    params.rd_eta = std::hypot(params.n - x0, params.lam - y0) - r;
+  };
+  scanner.scan();
+
+  // The finest grid has 129 x 129 points
+  ASSERT_LT(scanner.num_evaluations(), 129 * 129 / 5);
+
+  // Away from the points where the circle is tangent to the grid lines, the
+  // finest cells containing the circle must have been computed.
+  const double h = 4.0 / 128.0;
+  for (size_t n = 0; n < 360; n++) {
+    const double theta = 2.0 * M_PI * double(n) / 360.0;
+    if (std::abs(std::sin(2.0 * theta)) < 0.3) {
+      continue;
+    }
+    const auto i = size_t((x0 + r * std::cos(theta) + 2.0) / h);
+    const auto j = size_t((y0 + r * std::sin(theta) + 2.0) / h);
+    ASSERT_TRUE(scanner.is_evaluated(i, j));
+    ASSERT_TRUE(scanner.is_evaluated(i + 1, j));
+    ASSERT_TRUE(scanner.is_evaluated(i, j + 1));
+    ASSERT_TRUE(scanner.is_evaluated(i + 1, j + 1));
+  }
+  std::remove(fname.c_str());
+}